@@ -0,0 +1,22 @@
+#!/bin/sh
+
+### Time the interleaved tree descent against the sequential one on a
+### large tree (rocksample 15x15 at 2^17 simulations builds ~50k nodes,
+### well over 100 MB). Same seed and steps for every setting.
+
+### Problem definition
+problem=rocksample
+size=15
+number=15
+
+### Search and experiment parameters
+doubles=17
+numSteps=3
+runs=1
+interleaves="1 2 4 8 16"
+
+for interleave in $interleaves
+do
+    ./rage --problem $problem --size $size --number $number --minDoubles $doubles --maxDoubles $doubles --numSteps $numSteps --runs $runs --interleave $interleave --outputFile bench_interleave_$interleave.txt > /dev/null
+    echo "interleave $interleave: $(tail -n 1 bench_interleave_$interleave.txt | cut -f7) s"
+done
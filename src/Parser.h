@@ -39,7 +39,23 @@ namespace PARSER{
         int verbose = 0;
         int treeKnowledge = 1;
         int rolloutKnowledge = 1;
+        bool pgsCache = 0;
         bool fTable = 0;
+        int threads = 1;
+        bool constructive = 0;
+        int nodeParticles = 0;
+        bool lazyBeliefs = 0;
+        bool shareParticles = 0;
+        int maxNodes = 0;
+        bool pruneTree = 0;
+        int poolChunk = 256;
+        bool hugePages = 0;
+        bool trimMemory = 0;
+        bool pinThreads = 0;
+        int interleave = 1;
+        int asyncSimulations = 0;
+        double stepLatency = 0;
+        bool genericSearch = 0;
     };
     
     void parseCommandLine(char ** argv, int argc, COMMAND_LINE& cl){        
@@ -107,6 +123,70 @@ namespace PARSER{
                 cout << std::left << std::setw(20) << "--rolloutKnowledge";
                 cout << std::left << std::setw(100) << "Type of Rollout policy (0=Pure, 1=Legal, 2=Smart, 3=PGS)" << endl;
                 
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--pgsCache";
+                cout << std::left << std::setw(100) << "Reuse PGS rollout actions of states with the same rollout key (0 = off)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--threads";
+                cout << std::left << std::setw(100) << "Threads for particle reinvigoration (1 = sequential)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--constructive";
+                cout << std::left << std::setw(100) << "Condition local transforms on last observation (0 = rejection only)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--nodeParticles";
+                cout << std::left << std::setw(100) << "Max. particles kept per tree node (0 = unlimited)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--lazyBeliefs";
+                cout << std::left << std::setw(100) << "Sample initial belief states on demand (1) instead of up front (0)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--shareParticles";
+                cout << std::left << std::setw(100) << "Store equal tree node particles once in a shared arena (1) or per node (0)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--maxNodes";
+                cout << std::left << std::setw(100) << "Node budget for the search tree, 0 for unlimited" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--pruneTree";
+                cout << std::left << std::setw(100) << "Free least visited subtrees at the node budget (1) or only stop expanding (0)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--poolChunk";
+                cout << std::left << std::setw(100) << "Objects per memory pool chunk" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--hugePages";
+                cout << std::left << std::setw(100) << "Back memory pools with 2 MB pages (1) or the heap (0)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--trimMemory";
+                cout << std::left << std::setw(100) << "Return unused memory pool chunks after each step (1) or keep them (0)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--pinThreads";
+                cout << std::left << std::setw(100) << "Pin worker threads to CPUs spread over NUMA nodes (1) or not (0)" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--interleave";
+                cout << std::left << std::setw(100) << "Simulations descending the tree together, 1 for one at a time" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--asyncSimulations";
+                cout << std::left << std::setw(100) << "Simulations in flight with asynchronous simulator steps, 0 for off" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--stepLatency";
+                cout << std::left << std::setw(100) << "Latency of asynchronous simulator steps in milliseconds, run on a model thread" << endl;
+                
+                cout << std::setw(3) << "";
+                cout << std::left << std::setw(20) << "--genericSearch";
+                cout << std::left << std::setw(100) << "Search through virtual simulator calls (1) or specialised for the domain (0)" << endl;
+                
                 exit(0);
             }
             if(param == "--about"){
@@ -146,8 +226,40 @@ namespace PARSER{
                 cl.treeKnowledge = stoi(value);
             else if(param == "--rolloutKnowledge")
                 cl.rolloutKnowledge = stoi(value);
+            else if(param == "--pgsCache")
+                cl.pgsCache = stoi(value);
             else if(param == "--fTable")
                 cl.fTable = stoi(value);
+            else if(param == "--threads")
+                cl.threads = stoi(value);
+            else if(param == "--constructive")
+                cl.constructive = stoi(value);
+            else if(param == "--nodeParticles")
+                cl.nodeParticles = stoi(value);
+            else if(param == "--lazyBeliefs")
+                cl.lazyBeliefs = stoi(value);
+            else if(param == "--shareParticles")
+                cl.shareParticles = stoi(value);
+            else if(param == "--maxNodes")
+                cl.maxNodes = stoi(value);
+            else if(param == "--pruneTree")
+                cl.pruneTree = stoi(value);
+            else if(param == "--poolChunk")
+                cl.poolChunk = stoi(value);
+            else if(param == "--hugePages")
+                cl.hugePages = stoi(value);
+            else if(param == "--trimMemory")
+                cl.trimMemory = stoi(value);
+            else if(param == "--pinThreads")
+                cl.pinThreads = stoi(value);
+            else if(param == "--interleave")
+                cl.interleave = stoi(value);
+            else if(param == "--asyncSimulations")
+                cl.asyncSimulations = stoi(value);
+            else if(param == "--stepLatency")
+                cl.stepLatency = stod(value);
+            else if(param == "--genericSearch")
+                cl.genericSearch = stoi(value);
             else
                 cout << "Unrecognized parameter \"" << param << "\"" << endl;
         }
@@ -229,6 +341,8 @@ namespace PARSER{
                 drone_params.moving = stof(s_value);
             else if(param == "entropy")
                 drone_params.entropy = stof(s_value);
+            else if(param == "lazy")
+                drone_params.lazy = stoi(s_value);
             else
                 cout << "\tWarning: \"" << param << "\" is not a valid parameter." << endl;
         }        
@@ -356,6 +470,8 @@ namespace PARSER{
                 drone_params.moving = stof(s_value);
             else if(param == "entropy")
                 drone_params.entropy = stof(s_value);
+            else if(param == "lazy")
+                drone_params.lazy = stoi(s_value);
             else
                 cout << "\tWarning: \"" << param << "\" is not a valid parameter." << endl;
         }
@@ -1,33 +1,153 @@
 #include "beliefstate.h"
+#include "particlearena.h"
 #include "simulator.h"
 #include "utils.h"
 
 using namespace UTILS;
 
 BELIEF_STATE::BELIEF_STATE()
+:   NumParticles(0),
+    NumOffered(0),
+    Arena(0),
+    ArenaGeneration(0),
+    AliasValid(false),
+    Generative(false)
 {
     Samples.clear();
 }
 
 void BELIEF_STATE::Free(const SIMULATOR& simulator)
 {
-    for (std::vector<STATE*>::iterator i_state = Samples.begin();
+    if (Arena)
+    {
+        // Particles of an earlier generation were discarded with the arena
+        if (ArenaGeneration == Arena->GetGeneration())
+            for (int i = 0; i < (int) Handles.size(); ++i)
+                Arena->Release(Handles[i], simulator);
+        Handles.clear();
+        Arena = 0;
+    }
+    else for (std::vector<STATE*>::iterator i_state = Samples.begin();
             i_state != Samples.end(); ++i_state)
     {
         simulator.FreeState(*i_state);
     }
     Samples.clear();
+    Weights.clear();
+    Index.clear();
+    NumParticles = 0;
+    NumOffered = 0;
+    AliasValid = false;
+    Generative = false;
 }
 
 STATE* BELIEF_STATE::CreateSample(const SIMULATOR& simulator) const
 {
-    int index = Random(Samples.size());
+    if (Generative)
+        return simulator.CreateStartState();
+
+    int index;
+    if (NumParticles == (int) Samples.size())
+        index = Random(Samples.size());
+    else
+    {
+        if (!AliasValid)
+            BuildAliasTable();
+        index = Random(Samples.size());
+        if (RandomDouble(0, 1) >= AliasProb[index])
+            index = Alias[index];
+    }
     return simulator.Copy(*Samples[index]);
 }
 
+void BELIEF_STATE::PrepareSampling() const
+{
+    if (NumParticles != (int) Samples.size() && !AliasValid)
+        BuildAliasTable();
+}
+
 void BELIEF_STATE::AddSample(STATE* state)
 {
-    Samples.push_back(state);
+    Insert(state, 0, false);
+}
+
+void BELIEF_STATE::AddSample(STATE* state, const SIMULATOR& simulator)
+{
+    std::size_t hash;
+    if (!simulator.Hash(*state, hash))
+    {
+        Insert(state, 0, false);
+        return;
+    }
+
+    if (Merge(hash, *state, simulator))
+        simulator.FreeState(state);
+    else
+        Insert(state, hash, true);
+}
+
+void BELIEF_STATE::AddSampleCopy(const STATE& state, const SIMULATOR& simulator)
+{
+    if (Arena)
+    {
+        AddShared(state, simulator);
+        return;
+    }
+
+    std::size_t hash;
+    if (!simulator.Hash(state, hash))
+    {
+        Insert(simulator.Copy(state), 0, false);
+        return;
+    }
+
+    if (!Merge(hash, state, simulator))
+        Insert(simulator.Copy(state), hash, true);
+}
+
+// Algorithm R: the n-th state offered replaces a uniformly chosen
+// particle with probability capacity / n. Once full, most offers
+// return after one random draw, without copying the state.
+void BELIEF_STATE::AddSampleReservoir(const STATE& state, const SIMULATOR& simulator, int capacity)
+{
+    NumOffered++;
+    if (NumParticles < capacity)
+    {
+        AddSampleCopy(state, simulator);
+        return;
+    }
+
+    int particle = Random(NumOffered);
+    if (particle >= capacity)
+        return;
+    RemoveParticle(particle, simulator);
+    AddSampleCopy(state, simulator);
+}
+
+// The arena merges equal states, so equal particles of this node
+// have the same handle
+void BELIEF_STATE::AddShared(const STATE& state, const SIMULATOR& simulator)
+{
+    int handle = Arena->Acquire(state, simulator);
+    std::unordered_multimap<std::size_t, int>::const_iterator i_entry = Index.find(handle);
+    if (i_entry != Index.end())
+    {
+        Arena->Release(handle, simulator);
+        Weights[i_entry->second]++;
+        NumParticles++;
+        AliasValid = false;
+        return;
+    }
+
+    Insert(const_cast<STATE*>(Arena->Get(handle)), handle, true);
+    Handles.push_back(handle);
+}
+
+void BELIEF_STATE::SetArena(PARTICLE_ARENA* arena)
+{
+    assert(Samples.empty());
+    Arena = arena;
+    ArenaGeneration = arena->GetGeneration();
 }
 
 /*
@@ -35,29 +155,241 @@ void BELIEF_STATE::AddSample(STATE* state)
 */
 void BELIEF_STATE::Copy(const BELIEF_STATE& beliefs, const SIMULATOR& simulator)
 {
-    for (std::vector<STATE*>::const_iterator i_state = beliefs.Samples.begin();
-        i_state != beliefs.Samples.end(); ++i_state)
+    assert(!Arena && !beliefs.Arena);
+    if (Samples.empty())
+        Index = beliefs.Index;
+    else
+    {
+        for (std::unordered_multimap<std::size_t, int>::const_iterator i_entry = beliefs.Index.begin();
+                i_entry != beliefs.Index.end(); ++i_entry)
+            Index.insert(std::make_pair(i_entry->first, i_entry->second + (int) Samples.size()));
+    }
+
+    for (int i = 0; i < beliefs.GetNumSamples(); ++i)
     {
         //TODO: Copy state once features have been revised
 		  //(**i_state).validateTable();
-        AddSample(simulator.Copy(**i_state));
+        Samples.push_back(simulator.Copy(*beliefs.Samples[i]));
+        Weights.push_back(beliefs.Weights[i]);
     }
+    NumParticles += beliefs.NumParticles;
+    AliasValid = false;
 }
 
-void BELIEF_STATE::Move(BELIEF_STATE& beliefs)
+void BELIEF_STATE::Move(BELIEF_STATE& beliefs, const SIMULATOR& simulator)
 {
-    for (std::vector<STATE*>::const_iterator i_state = beliefs.Samples.begin();
-        i_state != beliefs.Samples.end(); ++i_state)
+    assert(!Arena);
+    if (beliefs.Arena)
     {
-        AddSample(*i_state);
+        // Shared particles become own states, the index is keyed by handle
+        assert(Samples.empty() && beliefs.ArenaGeneration == beliefs.Arena->GetGeneration());
+        for (int i = 0; i < (int) beliefs.Handles.size(); ++i)
+            beliefs.Samples[i] = beliefs.Arena->Detach(beliefs.Handles[i], simulator);
+        beliefs.Handles.clear();
+        beliefs.Arena = 0;
+        beliefs.Index.clear();
+        Samples.swap(beliefs.Samples);
+        Weights.swap(beliefs.Weights);
+        NumParticles = beliefs.NumParticles;
+        AliasValid = false;
+        Reindex(simulator);
+        beliefs.NumParticles = 0;
+        beliefs.NumOffered = 0;
+        beliefs.AliasValid = false;
+        return;
     }
+
+    for (std::unordered_multimap<std::size_t, int>::const_iterator i_entry = beliefs.Index.begin();
+            i_entry != beliefs.Index.end(); ++i_entry)
+        Index.insert(std::make_pair(i_entry->first, i_entry->second + (int) Samples.size()));
+
+    Samples.insert(Samples.end(), beliefs.Samples.begin(), beliefs.Samples.end());
+    Weights.insert(Weights.end(), beliefs.Weights.begin(), beliefs.Weights.end());
+    NumParticles += beliefs.NumParticles;
+    AliasValid = false;
+
     beliefs.Samples.clear();
+    beliefs.Weights.clear();
+    beliefs.Index.clear();
+    beliefs.NumParticles = 0;
+    beliefs.NumOffered = 0;
+    beliefs.AliasValid = false;
 }
 
-void BELIEF_STATE::activateFeature(int feature, bool status){
+void BELIEF_STATE::activateFeature(int feature, bool status, const SIMULATOR& simulator){
+    assert(!Arena);
     for (std::vector<STATE*>::const_iterator i_state = Samples.begin();
         i_state != Samples.end(); ++i_state){
 
         (*i_state)->activateFeature(feature, status);
     }
+
+    // Activation changes the states, so stored hashes are stale
+    Reindex(simulator);
+}
+
+bool BELIEF_STATE::Merge(std::size_t hash, const STATE& state, const SIMULATOR& simulator)
+{
+    std::pair<std::unordered_multimap<std::size_t, int>::const_iterator,
+        std::unordered_multimap<std::size_t, int>::const_iterator> range = Index.equal_range(hash);
+    for (std::unordered_multimap<std::size_t, int>::const_iterator i_entry = range.first;
+            i_entry != range.second; ++i_entry)
+    {
+        if (simulator.Equal(*Samples[i_entry->second], state))
+        {
+            Weights[i_entry->second]++;
+            NumParticles++;
+            AliasValid = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+void BELIEF_STATE::Insert(STATE* state, std::size_t hash, bool hashed)
+{
+    if (hashed)
+        Index.insert(std::make_pair(hash, (int) Samples.size()));
+    Samples.push_back(state);
+    Weights.push_back(1);
+    NumParticles++;
+    AliasValid = false;
+}
+
+// Drop one particle, counting through the samples by weight
+void BELIEF_STATE::RemoveParticle(int particle, const SIMULATOR& simulator)
+{
+    int index = 0;
+    while (particle >= Weights[index])
+        particle -= Weights[index++];
+
+    NumParticles--;
+    AliasValid = false;
+    if (--Weights[index] > 0)
+        return;
+
+    // Last copy of this state: move the final sample into its slot
+    int last = Samples.size() - 1;
+    Unindex(index, simulator, -1);
+    if (index != last)
+        Unindex(last, simulator, index);
+    if (Arena)
+    {
+        Arena->Release(Handles[index], simulator);
+        Handles[index] = Handles[last];
+        Handles.pop_back();
+    }
+    else
+        simulator.FreeState(Samples[index]);
+    Samples[index] = Samples[last];
+    Weights[index] = Weights[last];
+    Samples.pop_back();
+    Weights.pop_back();
+}
+
+// Remove the Index entry of a sample, or point it to newIndex
+void BELIEF_STATE::Unindex(int index, const SIMULATOR& simulator, int newIndex)
+{
+    std::size_t hash = Arena ? Handles[index] : 0;
+    if (Index.empty() || (!Arena && !simulator.Hash(*Samples[index], hash)))
+        return;
+
+    std::pair<std::unordered_multimap<std::size_t, int>::iterator,
+        std::unordered_multimap<std::size_t, int>::iterator> range = Index.equal_range(hash);
+    for (std::unordered_multimap<std::size_t, int>::iterator i_entry = range.first;
+            i_entry != range.second; ++i_entry)
+    {
+        if (i_entry->second == index)
+        {
+            if (newIndex < 0)
+                Index.erase(i_entry);
+            else
+                i_entry->second = newIndex;
+            return;
+        }
+    }
+}
+
+// Hash every sample again, after the index was keyed differently or the
+// states changed, and merge samples that have become equal
+void BELIEF_STATE::Reindex(const SIMULATOR& simulator)
+{
+    Index.clear();
+    int unique = 0;
+    for (int i = 0; i < (int) Samples.size(); ++i)
+    {
+        std::size_t hash;
+        bool hashed = simulator.Hash(*Samples[i], hash);
+        int match = -1;
+        if (hashed)
+        {
+            std::pair<std::unordered_multimap<std::size_t, int>::const_iterator,
+                std::unordered_multimap<std::size_t, int>::const_iterator> range = Index.equal_range(hash);
+            for (std::unordered_multimap<std::size_t, int>::const_iterator i_entry = range.first;
+                    i_entry != range.second && match < 0; ++i_entry)
+                if (simulator.Equal(*Samples[i_entry->second], *Samples[i]))
+                    match = i_entry->second;
+        }
+
+        if (match >= 0)
+        {
+            Weights[match] += Weights[i];
+            simulator.FreeState(Samples[i]);
+            continue;
+        }
+        if (hashed)
+            Index.insert(std::make_pair(hash, unique));
+        Samples[unique] = Samples[i];
+        Weights[unique] = Weights[i];
+        unique++;
+    }
+    Samples.resize(unique);
+    Weights.resize(unique);
+    AliasValid = false;
+}
+
+void BELIEF_STATE::BuildAliasTable() const
+{
+    int n = Samples.size();
+    AliasProb.resize(n);
+    Alias.resize(n);
+
+    std::vector<int> small, large;
+    std::vector<double> scaled(n);
+    for (int i = 0; i < n; ++i)
+    {
+        scaled[i] = (double) Weights[i] * n / NumParticles;
+        if (scaled[i] < 1.0)
+            small.push_back(i);
+        else
+            large.push_back(i);
+    }
+
+    while (!small.empty() && !large.empty())
+    {
+        int s = small.back(), l = large.back();
+        small.pop_back();
+        AliasProb[s] = scaled[s];
+        Alias[s] = l;
+        scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+        if (scaled[l] < 1.0)
+        {
+            large.pop_back();
+            small.push_back(l);
+        }
+    }
+
+    // Remaining entries are (numerically) full
+    for (int i = 0; i < (int) large.size(); ++i)
+    {
+        AliasProb[large[i]] = 1.0;
+        Alias[large[i]] = large[i];
+    }
+    for (int i = 0; i < (int) small.size(); ++i)
+    {
+        AliasProb[small[i]] = 1.0;
+        Alias[small[i]] = small[i];
+    }
+
+    AliasValid = true;
 }
@@ -2,10 +2,25 @@
 #define BELIEF_STATE_H
 
 #include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <stdint.h>
 
 class STATE;
 class SIMULATOR;
+class PARTICLE_ARENA;
 
+/*
+    Particles are stored once per unique state with an integer weight.
+    Domains that implement SIMULATOR::Hash/Equal get duplicates merged on
+    insertion; all other domains keep one entry of weight 1 per sample.
+    Weighted sampling uses an alias table that is rebuilt lazily.
+    Tree nodes can cap their particles with AddSampleReservoir.
+    A generative belief state holds no particles and draws every sample
+    from SIMULATOR::CreateStartState instead.
+    Tree node beliefs can keep their particles in a PARTICLE_ARENA, shared
+    with other nodes, and then hold arena handles instead of own copies.
+*/
 class BELIEF_STATE
 {
 public:
@@ -18,26 +33,76 @@ public:
     // Creates new state, now owned by caller
     STATE* CreateSample(const SIMULATOR& simulator) const;
 
+    // Build sampling tables up front, so that several threads
+    // can call CreateSample concurrently
+    void PrepareSampling() const;
+
     // Added state is owned by belief state
     void AddSample(STATE* state);
 
+    // Added state is owned by belief state, merged with an equal state if present
+    void AddSample(STATE* state, const SIMULATOR& simulator);
+
+    // Add a copy of state, only allocated if no equal state is present
+    void AddSampleCopy(const STATE& state, const SIMULATOR& simulator);
+
+    // Keep at most capacity particles out of all states offered so far,
+    // as a uniform sample (reservoir sampling)
+    void AddSampleReservoir(const STATE& state, const SIMULATOR& simulator, int capacity);
+
+    // Keep samples added from now on in the arena (belief must be empty)
+    void SetArena(PARTICLE_ARENA* arena);
+
     // Make own copies of all samples
     void Copy(const BELIEF_STATE& beliefs, const SIMULATOR& simulator);
 
-    // Move all samples into this belief state
-    void Move(BELIEF_STATE& beliefs);
+    // Move all samples into this belief state, taking arena particles
+    // over when no other node shares them
+    void Move(BELIEF_STATE& beliefs, const SIMULATOR& simulator);
+
+    // Draw every sample from CreateStartState instead of stored particles
+    void SetGenerative(bool generative) { Generative = generative; }
+    bool IsGenerative() const { return Generative; }
 
-    bool Empty() const { return Samples.empty(); }
+    bool Empty() const { return Samples.empty() && !Generative; }
     int GetNumSamples() const { return Samples.size(); }
+    int GetNumParticles() const { return NumParticles; }
+    int GetWeight(int index) const { return Weights[index]; }
     const STATE* GetSample(int index) const { return Samples[index]; }
     const STATE* GetMostRecentSample() const { return Samples.back(); }
 
     //Feature activation in all states
-    void activateFeature(int feature, bool status);
+    void activateFeature(int feature, bool status, const SIMULATOR& simulator);
 
 private:
 
+    bool Merge(std::size_t hash, const STATE& state, const SIMULATOR& simulator);
+    void Insert(STATE* state, std::size_t hash, bool hashed);
+    void AddShared(const STATE& state, const SIMULATOR& simulator);
+    void RemoveParticle(int particle, const SIMULATOR& simulator);
+    void Unindex(int index, const SIMULATOR& simulator, int newIndex);
+    void Reindex(const SIMULATOR& simulator);
+    void BuildAliasTable() const;
+
     std::vector<STATE*> Samples;
+    std::vector<int> Weights;
+    int NumParticles;
+    int NumOffered; // States offered to the reservoir
+
+    // Hash of each unique sample (arena handle with an arena) -> index into Samples
+    std::unordered_multimap<std::size_t, int> Index;
+
+    // Arena of shared particles, Handles[i] refers to Samples[i]
+    PARTICLE_ARENA* Arena;
+    uint32_t ArenaGeneration;
+    std::vector<int> Handles;
+
+    // Alias table for weighted sampling (Vose)
+    mutable std::vector<double> AliasProb;
+    mutable std::vector<int> Alias;
+    mutable bool AliasValid;
+
+    bool Generative;
 };
 
 #endif // BELIEF_STATE_H
@@ -83,6 +83,7 @@ CELLAR::CELLAR(PROBLEM_PARAMS& problem_params)
     BIN_ENTROPY_LIMIT = params.entropy;
     ACTIVATION_THRESHOLD = params.activation;
     PGSAlpha = params.PGSAlpha;
+    RewardCheck = -0.5;
 
 //    cout << "Gammas: " << Discount << ", " << fDiscount << endl;
 //    cout << "Limits: " << BIN_ENTROPY_LIMIT << ", " << ACTIVATION_THRESHOLD << endl;
@@ -101,6 +102,21 @@ CELLAR::CELLAR(PROBLEM_PARAMS& problem_params)
         Init_Ftest();
     else
         InitGeneral();
+
+    InitEfficiency();
+    EntropyBound = BinaryEntropyBound(BIN_ENTROPY_LIMIT);
+}
+
+void CELLAR::InitEfficiency()
+{
+    // Sensor efficiency only depends on the offset to the checked item
+    Efficiency.Resize(Size, Size);
+    for (int x = 0; x < Size; ++x)
+        for (int y = 0; y < Size; ++y)
+        {
+            double distance = COORD::EuclideanDistance(COORD(0, 0), COORD(x, y));
+            Efficiency(x, y) = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+        }
 }
 
 void CELLAR::Init_5_1(){
@@ -413,6 +429,67 @@ STATE* CELLAR::Copy(const STATE& state) const
     return newstate;
 }
 
+bool CELLAR::Hash(const STATE& state, std::size_t& hash) const
+{
+    const CELLAR_STATE& cellarstate = safe_cast<const CELLAR_STATE&>(state);
+    hash = 0;
+    HashCombine(hash, cellarstate.AgentPos.X);
+    HashCombine(hash, cellarstate.AgentPos.Y);
+    HashCombine(hash, cellarstate.CollectedBottles);
+    for (int i = 0; i < NumBottles; i++)
+    {
+        const CELLAR_STATE::ENTRY& entry = cellarstate.Bottles[i];
+        HashCombine(hash, entry.Valuable + 2 * entry.Collected);
+        HashCombine(hash, entry.Count);
+        HashCombine(hash, entry.Measured);
+        HashCombine(hash, entry.ProbValuable);
+    }
+    for (int i = 0; i < NumObjects; i++)
+    {
+        const CELLAR_STATE::OBJ_ENTRY& entry = cellarstate.Objects[i];
+        HashCombine(hash, entry.ObjPos.X);
+        HashCombine(hash, entry.ObjPos.Y);
+        HashCombine(hash, entry.Type + 8 * entry.AssumedType + 64 * entry.active);
+        HashCombine(hash, entry.Count);
+        HashCombine(hash, entry.Measured);
+        HashCombine(hash, entry.ProbCrate);
+    }
+    return true;
+}
+
+bool CELLAR::Equal(const STATE& state1, const STATE& state2) const
+{
+    const CELLAR_STATE& cellarstate1 = safe_cast<const CELLAR_STATE&>(state1);
+    const CELLAR_STATE& cellarstate2 = safe_cast<const CELLAR_STATE&>(state2);
+    if (cellarstate1.AgentPos != cellarstate2.AgentPos
+        || cellarstate1.CollectedBottles != cellarstate2.CollectedBottles)
+        return false;
+    for (int i = 0; i < NumBottles; i++)
+    {
+        const CELLAR_STATE::ENTRY& entry1 = cellarstate1.Bottles[i];
+        const CELLAR_STATE::ENTRY& entry2 = cellarstate2.Bottles[i];
+        if (entry1.Valuable != entry2.Valuable || entry1.Collected != entry2.Collected
+            || entry1.Count != entry2.Count || entry1.Measured != entry2.Measured
+            || entry1.LikelihoodValuable != entry2.LikelihoodValuable
+            || entry1.LikelihoodWorthless != entry2.LikelihoodWorthless
+            || entry1.ProbValuable != entry2.ProbValuable)
+            return false;
+    }
+    for (int i = 0; i < NumObjects; i++)
+    {
+        const CELLAR_STATE::OBJ_ENTRY& entry1 = cellarstate1.Objects[i];
+        const CELLAR_STATE::OBJ_ENTRY& entry2 = cellarstate2.Objects[i];
+        if (entry1.ObjPos != entry2.ObjPos || entry1.Type != entry2.Type
+            || entry1.Count != entry2.Count || entry1.Measured != entry2.Measured
+            || entry1.LikelihoodCrate != entry2.LikelihoodCrate
+            || entry1.LikelihoodShelf != entry2.LikelihoodShelf
+            || entry1.ProbCrate != entry2.ProbCrate
+            || entry1.AssumedType != entry2.AssumedType || entry1.active != entry2.active)
+            return false;
+    }
+    return true;
+}
+
 void CELLAR::Validate(const STATE& state) const
 {
     const CELLAR_STATE& cellarstate = safe_cast<const CELLAR_STATE&>(state);
@@ -426,6 +503,8 @@ STATE* CELLAR::CreateStartState() const
 	cellarstate->CollectedBottles = 0;
     cellarstate->Bottles.clear();
 	cellarstate->Objects.clear();
+	cellarstate->ObjectAt.assign(Size * Size, -1);
+	cellarstate->Occupied.assign((Size * Size + 63) / 64, 0);
 	
     for (int i = 0; i < NumBottles; i++)
     {
@@ -459,6 +538,10 @@ STATE* CELLAR::CreateStartState() const
 		entry.AssumedType = E_NONE;
 		entry.active = true;
         cellarstate->Objects.push_back(entry);
+
+		int cell = Grid.Index(ObjectPos[i]);
+		cellarstate->ObjectAt[cell] = i;
+		cellarstate->Occupied[cell >> 6] |= (uint64_t) 1 << (cell & 63);
     }
 	
     assert(cellarstate->Objects.size() == NumObjects);
@@ -523,7 +606,6 @@ bool CELLAR::StepNormal(STATE& state, int action,
     reward = 0;
     observation = E_NONE;
 	
-	double reward_check = -0.5;
 	int reward_move = -1;
 	int reward_push = -2;
 	
@@ -667,8 +749,7 @@ bool CELLAR::StepNormal(STATE& state, int action,
 				cellarstate.AgentPos.Y += offsetY;
 				
 				// Update the objects known position
-				cellarstate.Objects[objNum].ObjPos.X += offsetX;
-				cellarstate.Objects[objNum].ObjPos.Y += offsetY;
+				MoveObject(cellarstate, objNum, pos2);
 				
 				reward = reward_push; //Push cost punishment
 			}
@@ -683,30 +764,11 @@ bool CELLAR::StepNormal(STATE& state, int action,
         int bottle = action - E_BOTTLECHECK;
         assert(bottle < NumBottles);
         observation = GetObservation(cellarstate, bottle, 1);
-        cellarstate.Bottles[bottle].Measured++;
-
-        double distance = COORD::EuclideanDistance(cellarstate.AgentPos, BottlePos[bottle]);
-    	double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
 
-        if (observation == E_GOOD)
-        {
-            cellarstate.Bottles[bottle].Count++;
-            cellarstate.Bottles[bottle].LikelihoodValuable *= efficiency;
-            cellarstate.Bottles[bottle].LikelihoodWorthless *= 1.0 - efficiency;
-
-        }
-        else
-        {
-            cellarstate.Bottles[bottle].Count--;
-            cellarstate.Bottles[bottle].LikelihoodWorthless *= efficiency;
-            cellarstate.Bottles[bottle].LikelihoodValuable *= 1.0 - efficiency;
-		  }
-		double denom = (0.5 * cellarstate.Bottles[bottle].LikelihoodValuable) +
-			(0.5 * cellarstate.Bottles[bottle].LikelihoodWorthless);
-		cellarstate.Bottles[bottle].ProbValuable = (0.5 * cellarstate.Bottles[bottle].LikelihoodValuable) / denom;
+        UpdateBottleCheck(cellarstate, bottle, observation, CheckEfficiency(cellarstate.AgentPos, BottlePos[bottle]));
 		  
 		//NOTE: Check action punishment
-		reward = reward_check;
+		reward = RewardCheck;
     }
 	 
 	 // Check object returns a noisy reading of the type
@@ -717,52 +779,155 @@ bool CELLAR::StepNormal(STATE& state, int action,
         assert(obj < NumObjects);
 		 
         observation = GetObservation(cellarstate, obj, 2);
-        cellarstate.Objects[obj].Measured++;
 
-        double distance = COORD::EuclideanDistance(cellarstate.AgentPos, cellarstate.Objects[obj].ObjPos);
-    	double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+        UpdateObjectCheck(cellarstate, obj, observation, CheckEfficiency(cellarstate.AgentPos, cellarstate.Objects[obj].ObjPos));
+		//Note: Check action punishment
+		reward = RewardCheck;
+    }
+	 	 
+    return false;
+}
+
+
+/*
+ * Batched step.  Check actions of all particles are gathered into flat arrays
+ * (distance -> efficiency, random draws) and resolved in tight loops, every
+ * other action goes through StepNormal.
+ */
+void CELLAR::StepBatch(STATE** states, const int* actions,
+    int* observations, double* rewards, bool* terminal, int n) const
+{
+    static thread_local std::vector<STATE*> oldstates;
+    static thread_local std::vector<int> checks;
+    static thread_local std::vector<double> efficiency;
+    static thread_local std::vector<int> draws;
+
+    bool pgs = Knowledge.RolloutLevel >= KNOWLEDGE::PGS;
+    if (pgs)
+    {
+        oldstates.resize(n);
+        for (int i = 0; i < n; ++i)
+            oldstates[i] = Copy(*states[i]);
+    }
 
-        if (observation == E_CRATE)
+    checks.clear();
+    for (int i = 0; i < n; ++i)
+    {
+        if (actions[i] >= E_BOTTLECHECK && actions[i] < E_BPUSHNORTH)
+            checks.push_back(i);
+        else
         {
-            cellarstate.Objects[obj].Count++;
-            cellarstate.Objects[obj].LikelihoodCrate *= efficiency;
-            cellarstate.Objects[obj].LikelihoodShelf *= 1.0 - efficiency;
+            bool result = StepNormal(*states[i], actions[i], observations[i], rewards[i]);
+            if (terminal)
+                terminal[i] = result;
+        }
+    }
 
+    int numChecks = checks.size();
+    efficiency.resize(numChecks);
+    draws.resize(numChecks);
+    for (int k = 0; k < numChecks; ++k)
+    {
+        const CELLAR_STATE& cellarstate = safe_cast<const CELLAR_STATE&>(*states[checks[k]]);
+        int action = actions[checks[k]];
+        const COORD& pos = action < E_OBJCHECK ? BottlePos[action - E_BOTTLECHECK]
+            : cellarstate.Objects[action - E_OBJCHECK].ObjPos;
+        efficiency[k] = CheckEfficiency(cellarstate.AgentPos, pos);
+    }
+    for (int k = 0; k < numChecks; ++k)
+        draws[k] = Rand();
+
+    for (int k = 0; k < numChecks; ++k)
+    {
+        int i = checks[k];
+        CELLAR_STATE& cellarstate = safe_cast<CELLAR_STATE&>(*states[i]);
+        bool correct = draws[k] < efficiency[k] * RAND_MAX;
+
+        if (actions[i] < E_OBJCHECK)
+        {
+            int bottle = actions[i] - E_BOTTLECHECK;
+            observations[i] = (correct == cellarstate.Bottles[bottle].Valuable) ? E_GOOD : E_BAD;
+            UpdateBottleCheck(cellarstate, bottle, observations[i], efficiency[k]);
         }
         else
         {
-            cellarstate.Objects[obj].Count--;
-            cellarstate.Objects[obj].LikelihoodShelf *= efficiency;
-            cellarstate.Objects[obj].LikelihoodCrate *= 1.0 - efficiency;
-		}
-		double denom = (0.5 * cellarstate.Objects[obj].LikelihoodCrate) +
-			(0.5 * cellarstate.Objects[obj].LikelihoodShelf);
-		cellarstate.Objects[obj].ProbCrate = (0.5 * cellarstate.Objects[obj].LikelihoodCrate) / denom;
-		
-		//As soon as entropy is reduced, assume the closest type
-		if(cellarstate.Objects[obj].AssumedType == E_NONE){
-			double p = cellarstate.Objects[obj].ProbCrate;
-			double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);
-		
-			if(binaryEntropy <= CELLAR::BIN_ENTROPY_LIMIT){
-				//cout << "For object " << obj << " ";
-				if(round(cellarstate.Objects[obj].ProbCrate)){
-					cellarstate.Objects[obj].AssumedType = E_CRATE;
-					//cout << "with P(crate) = " << cellarstate.Objects[obj].ProbCrate << " assumed CRATE" << endl;
-				}
-				else{
-					cellarstate.Objects[obj].AssumedType = E_SHELF;
-					//cout << "with P(crate) = " << cellarstate.Objects[obj].ProbCrate << " assumed SHELF" << endl;
-				}
-			}
-		}
-		//Note: Check action punishment
-		reward = reward_check;
+            int obj = actions[i] - E_OBJCHECK;
+            bool crate = cellarstate.Objects[obj].Type == E_CRATE;
+            observations[i] = (correct == crate) ? E_CRATE : E_SHELF;
+            UpdateObjectCheck(cellarstate, obj, observations[i], efficiency[k]);
+        }
+        rewards[i] = RewardCheck;
+        if (terminal)
+            terminal[i] = false;
     }
-	 	 
-    return false;
+
+    // Potential-based reward bonus, as in StepPGS
+    if (pgs)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            if (rewards[i] != -100)
+            {
+                double r2 = PGS(*oldstates[i]);
+                double r = PGS_RO(*oldstates[i], *states[i], actions[i], r2);
+                rewards[i] += PGSAlpha*r - PGSAlpha*r2;
+            }
+            FreeState(oldstates[i]);
+        }
+    }
+}
+
+void CELLAR::UpdateBottleCheck(CELLAR_STATE& cellarstate, int bottle,
+    int observation, double efficiency) const
+{
+    cellarstate.Bottles[bottle].Measured++;
+    if (observation == E_GOOD)
+    {
+        cellarstate.Bottles[bottle].Count++;
+        cellarstate.Bottles[bottle].LikelihoodValuable *= efficiency;
+        cellarstate.Bottles[bottle].LikelihoodWorthless *= 1.0 - efficiency;
+    }
+    else
+    {
+        cellarstate.Bottles[bottle].Count--;
+        cellarstate.Bottles[bottle].LikelihoodWorthless *= efficiency;
+        cellarstate.Bottles[bottle].LikelihoodValuable *= 1.0 - efficiency;
+    }
+    double denom = (0.5 * cellarstate.Bottles[bottle].LikelihoodValuable) +
+        (0.5 * cellarstate.Bottles[bottle].LikelihoodWorthless);
+    cellarstate.Bottles[bottle].ProbValuable = (0.5 * cellarstate.Bottles[bottle].LikelihoodValuable) / denom;
 }
 
+void CELLAR::UpdateObjectCheck(CELLAR_STATE& cellarstate, int obj,
+    int observation, double efficiency) const
+{
+    cellarstate.Objects[obj].Measured++;
+    if (observation == E_CRATE)
+    {
+        cellarstate.Objects[obj].Count++;
+        cellarstate.Objects[obj].LikelihoodCrate *= efficiency;
+        cellarstate.Objects[obj].LikelihoodShelf *= 1.0 - efficiency;
+    }
+    else
+    {
+        cellarstate.Objects[obj].Count--;
+        cellarstate.Objects[obj].LikelihoodShelf *= efficiency;
+        cellarstate.Objects[obj].LikelihoodCrate *= 1.0 - efficiency;
+    }
+    double denom = (0.5 * cellarstate.Objects[obj].LikelihoodCrate) +
+        (0.5 * cellarstate.Objects[obj].LikelihoodShelf);
+    cellarstate.Objects[obj].ProbCrate = (0.5 * cellarstate.Objects[obj].LikelihoodCrate) / denom;
+
+    //As soon as entropy is reduced, assume the closest type
+    if(cellarstate.Objects[obj].AssumedType == E_NONE){
+        if(LowEntropy(cellarstate.Objects[obj].ProbCrate, EntropyBound)){
+            if(round(cellarstate.Objects[obj].ProbCrate))
+                cellarstate.Objects[obj].AssumedType = E_CRATE;
+            else
+                cellarstate.Objects[obj].AssumedType = E_SHELF;
+        }
+    }
+}
 
 //Create local domain transformations
 bool CELLAR::LocalMove(STATE& state, const HISTORY& history,
@@ -782,7 +947,7 @@ bool CELLAR::LocalMove(STATE& state, const HISTORY& history,
 	else
 		cellarstate.Objects[obj].Type = E_CRATE;
 	 
-    if (history.Back().Action >= E_BOTTLECHECK){
+    if (history.Back().Action >= E_BOTTLECHECK && history.Back().Action < E_BPUSHNORTH){
         //Bottle check?
 		if(history.Back().Action < E_OBJCHECK){
             bottle = history.Back().Action - E_BOTTLECHECK;
@@ -820,6 +985,74 @@ bool CELLAR::LocalMove(STATE& state, const HISTORY& history,
     return true;
 }
 
+// Item to flip out of n, where flipping the checked item leaves likelihood
+// lflip for the last observation and flipping any other item leaves lcur.
+// The flip is accepted at the rate of rejection sampling, total / n, over
+// the largest likelihood, so that states are not over-represented when
+// they explain the observation badly. Returns -1 if not accepted.
+static int ConditionedFlip(int n, int checked, double lcur, double lflip)
+{
+	double total = lflip + (n - 1) * lcur;
+	if (total <= 0 || !Bernoulli(total / (n * std::max(lcur, lflip))))
+		return -1;
+	if (n == 1 || Bernoulli(lflip / total))
+		return lflip > 0 ? checked : -1;
+	int index = Random(n - 1);
+	return index >= checked ? index + 1 : index;
+}
+
+//Constructive version of LocalMove
+//Same bottle and object flips, but the checked bottle (or object) is flipped
+//with probability proportional to the likelihood of the real observation
+bool CELLAR::ConditionedMove(STATE& state, const HISTORY& history,
+    int stepObs, const STATUS& status) const
+{
+    CELLAR_STATE& cellarstate = safe_cast<CELLAR_STATE&>(state);
+	int action = history.Back().Action;
+	int realObs = history.Back().Observation;
+	int bottle = Random(NumBottles);
+	int obj = Random(NumObjects);
+
+	if (action >= E_BOTTLECHECK && action < E_OBJCHECK){
+		int checked = action - E_BOTTLECHECK;
+		double efficiency = CheckEfficiency(cellarstate.AgentPos, BottlePos[checked]);
+		bool explained = (realObs == E_GOOD) == cellarstate.Bottles[checked].Valuable;
+		double lcur = explained ? efficiency : 1.0 - efficiency;
+
+		bottle = ConditionedFlip(NumBottles, checked, lcur, 1.0 - lcur);
+		if (bottle < 0)
+			return false;
+
+		if (realObs == E_GOOD && stepObs == E_BAD)
+			cellarstate.Bottles[checked].Count += 2;
+		if (realObs == E_BAD && stepObs == E_GOOD)
+			cellarstate.Bottles[checked].Count -= 2;
+	}
+	else if (action >= E_OBJCHECK && action < E_BPUSHNORTH){
+		int checked = action - E_OBJCHECK;
+		double efficiency = CheckEfficiency(cellarstate.AgentPos, cellarstate.Objects[checked].ObjPos);
+		bool explained = (realObs == E_CRATE) == (cellarstate.Objects[checked].Type == E_CRATE);
+		double lcur = explained ? efficiency : 1.0 - efficiency;
+
+		obj = ConditionedFlip(NumObjects, checked, lcur, 1.0 - lcur);
+		if (obj < 0)
+			return false;
+
+		if (realObs == E_CRATE && stepObs == E_SHELF)
+			cellarstate.Objects[checked].Count += 2;
+		if (realObs == E_SHELF && stepObs == E_CRATE)
+			cellarstate.Objects[checked].Count -= 2;
+	}
+
+	cellarstate.Bottles[bottle].Valuable = !cellarstate.Bottles[bottle].Valuable;
+	if(cellarstate.Objects[obj].Type == E_CRATE)
+		cellarstate.Objects[obj].Type = E_SHELF;
+	else
+		cellarstate.Objects[obj].Type = E_CRATE;
+
+    return true;
+}
+
 /* PGS Rollout policy
  * Simplified PGS point count
  */
@@ -844,13 +1077,8 @@ double CELLAR::PGS_RO(STATE& oldstate, STATE& state, int action, double oldpgs)
 	}
 	else if (action >= E_BOTTLECHECK && action < E_OBJCHECK){ //Bottle check
 		bottle = action - E_BOTTLECHECK;
-		double p = cellarstate.Bottles[bottle].ProbValuable;
-		double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);
-		if(binaryEntropy > CELLAR::BIN_ENTROPY_LIMIT) points--;
-		
-		p = oldcellarstate.Bottles[bottle].ProbValuable;
-		double oldBinaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);
-		if(oldBinaryEntropy > CELLAR::BIN_ENTROPY_LIMIT) oldpoints--;
+		if(HighEntropy(cellarstate.Bottles[bottle].ProbValuable, EntropyBound)) points--;
+		if(HighEntropy(oldcellarstate.Bottles[bottle].ProbValuable, EntropyBound)) oldpoints--;
 		//else points -= 0.5;
 	}
 
@@ -882,9 +1110,7 @@ double CELLAR::PGS(STATE& state) const
 			else points--;
 		}
 		else{
-			double p = cellarstate.Bottles[bottle].ProbValuable;
-			double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);
-			if(binaryEntropy > CELLAR::BIN_ENTROPY_LIMIT) points--;
+			if(HighEntropy(cellarstate.Bottles[bottle].ProbValuable, EntropyBound)) points--;
 
 		}
 	}
@@ -892,6 +1118,31 @@ double CELLAR::PGS(STATE& state) const
 	return points;
 }
 
+// Everything PGSLegal, StepNormal and PGS_RO read for the PGS rollout policy
+bool CELLAR::RolloutKey(const STATE& state, uint64_t& key) const
+{
+	const CELLAR_STATE& cellarstate = safe_cast<const CELLAR_STATE&>(state);
+	std::size_t hash = 0;
+	HashCombine(hash, cellarstate.AgentPos.X);
+	HashCombine(hash, cellarstate.AgentPos.Y);
+	for (int bottle = 0; bottle < NumBottles; ++bottle)
+	{
+		const CELLAR_STATE::ENTRY& entry = cellarstate.Bottles[bottle];
+		HashCombine(hash, entry.Valuable + 2 * entry.Collected + 4 * (entry.Count != 0));
+		if (!entry.Collected)
+			HashCombine(hash, entry.ProbValuable);
+	}
+	for (int obj = 0; obj < NumObjects; ++obj)
+	{
+		const CELLAR_STATE::OBJ_ENTRY& entry = cellarstate.Objects[obj];
+		HashCombine(hash, entry.ObjPos.X);
+		HashCombine(hash, entry.ObjPos.Y);
+		HashCombine(hash, entry.AssumedType + 8 * entry.active);
+	}
+	key = hash;
+	return true;
+}
+
 // PGS Rollout policy
 // Computes PGS only for non-checking actions
 void CELLAR::GeneratePGS(const STATE& state, const HISTORY& history,
@@ -1016,30 +1267,15 @@ void CELLAR::PGSLegal(const STATE& state, const HISTORY& history,
 		legal.push_back(E_BPUSHWEST + Grid(posW));
 	}	 
 	 
-	bool objsFound = false; //objN && objE && objS && objW;
-
 	//Pushing is allowed for active objects only
-	for(int i=0; i<cellarstate.Objects.size() && !objsFound; i++){
-		if(cellarstate.Objects[i].active){ //only use active objects
-			if(cellarstate.Objects[i].ObjPos == posN){
-				objN = true;
-				numObjN = i;
-			}
-			if(cellarstate.Objects[i].ObjPos == posE){
-				objE = true;
-				numObjE = i;
-			}
-			if(cellarstate.Objects[i].ObjPos == posS){
-				objS = true;
-				numObjS = i;
-			}
-			if(cellarstate.Objects[i].ObjPos == posW){
-				objW = true;
-				numObjW = i;
-			}
-			objsFound = objN && objE && objS && objW;
-		}
-	}
+	numObjN = ActiveObjectNumber(cellarstate, posN);
+	numObjE = ActiveObjectNumber(cellarstate, posE);
+	numObjS = ActiveObjectNumber(cellarstate, posS);
+	numObjW = ActiveObjectNumber(cellarstate, posW);
+	objN = numObjN >= 0;
+	objE = numObjE >= 0;
+	objS = numObjS >= 0;
+	objW = numObjW >= 0;
 		  
 		  
 	if (cellarstate.AgentPos.Y + 1 < Size && objN)
@@ -1121,29 +1357,15 @@ void CELLAR::GenerateLegal(const STATE& state, const HISTORY& history,
 		  
 	int numObjN, numObjS, numObjE, numObjW;
 	 
-	bool objsFound = false; //objN && objE && objS && objW;
-		  
-	for(int i=0; i<cellarstate.Objects.size() && !objsFound; i++){
-	 	if(cellarstate.Objects[i].active){
-			if (cellarstate.Objects[i].ObjPos == posN) {
-				objN = true;
-				numObjN = i;
-			}
-			if (cellarstate.Objects[i].ObjPos == posE) {
-				objE = true;
-				numObjE = i;
-			}
-			if (cellarstate.Objects[i].ObjPos == posS) {
-				objS = true;
-				numObjS = i;
-			}
-			if (cellarstate.Objects[i].ObjPos == posW) {
-				objW = true;
-				numObjW = i;
-			}
-			objsFound = objN && objE && objS && objW;
-		}
-	}
+	//Pushing is allowed for active objects only
+	numObjN = ActiveObjectNumber(cellarstate, posN);
+	numObjE = ActiveObjectNumber(cellarstate, posE);
+	numObjS = ActiveObjectNumber(cellarstate, posS);
+	numObjW = ActiveObjectNumber(cellarstate, posW);
+	objN = numObjN >= 0;
+	objE = numObjE >= 0;
+	objS = numObjS >= 0;
+	objW = numObjW >= 0;
 		  
 		  
 	if (cellarstate.AgentPos.Y + 1 < Size && objN)
@@ -1179,20 +1401,10 @@ void CELLAR::GeneratePreferred(const STATE& state, const HISTORY& history,
 
 		// Sample rocks with more +ve than -ve observations
 		int rock = Grid(cellarstate.AgentPos);
+		// (Count is the tally of good minus bad check observations)
 		if (rock >= 0 && rock < NumBottles && !cellarstate.Bottles[rock].Collected)
 		{
-			int total = 0;
-			for (int t = 0; t < history.Size(); ++t)
-			{
-				if (history[t].Action == rock + 1 + E_SAMPLE)
-				{
-					if (history[t].Observation == E_GOOD)
-						total++;
-					if (history[t].Observation == E_BAD)
-						total--;
-				}
-			}
-			if (total > 0)
+			if (cellarstate.Bottles[rock].Count > 0)
 			{
 				actions.push_back(E_SAMPLE + rock);
 				return;
@@ -1212,19 +1424,7 @@ void CELLAR::GeneratePreferred(const STATE& state, const HISTORY& history,
 			const CELLAR_STATE::ENTRY& entry = cellarstate.Bottles[rock];
 			if (!entry.Collected)
 			{
-				int total = 0;
-				for (int t = 0; t < history.Size(); ++t)
-				{
-					if (history[t].Action == rock + 1 + E_SAMPLE)
-					{
-						if (history[t].Observation == E_GOOD)
-							total++;
-						if (history[t].Observation == E_BAD)
-							total--;
-					}
-				}
-
-				if (total >= 0)
+				if (entry.Count >= 0)
 				{
 					all_bad = false;
 
@@ -1319,29 +1519,15 @@ void CELLAR::GeneratePreferred(const STATE& state, const HISTORY& history,
 	 
 	int numObjN, numObjS, numObjE, numObjW;
 	 
-	bool objsFound = objN && objE && objS && objW;
-		  
-	for(int i=0; i<cellarstate.Objects.size() && !objsFound; i++){
-        if(cellarstate.Objects[i].active) {
-            if (cellarstate.Objects[i].ObjPos == posN) {
-                objN = true;
-                numObjN = i;
-            }
-            if (cellarstate.Objects[i].ObjPos == posE) {
-                objE = true;
-                numObjE = i;
-            }
-            if (cellarstate.Objects[i].ObjPos == posS) {
-                objS = true;
-                numObjS = i;
-            }
-            if (cellarstate.Objects[i].ObjPos == posW) {
-                objW = true;
-                numObjW = i;
-            }
-        }
-        objsFound = objN && objE && objS && objW;
-	}
+	//Pushing is allowed for active objects only
+	numObjN = ActiveObjectNumber(cellarstate, posN);
+	numObjE = ActiveObjectNumber(cellarstate, posE);
+	numObjS = ActiveObjectNumber(cellarstate, posS);
+	numObjW = ActiveObjectNumber(cellarstate, posW);
+	objN = numObjN >= 0;
+	objE = numObjE >= 0;
+	objS = numObjS >= 0;
+	objW = numObjW >= 0;
 		  
 		  
     if (cellarstate.AgentPos.Y + 1 < Size && objN)
@@ -1359,62 +1545,70 @@ void CELLAR::GeneratePreferred(const STATE& state, const HISTORY& history,
 
 ///// Utility/domain fuctions /////
 bool CELLAR::CrateAt(const CELLAR_STATE& cellarstate, const COORD& coord) const{
-	for(int i=0; i<cellarstate.Objects.size(); i++){
-		if(cellarstate.Objects[i].ObjPos == coord && cellarstate.Objects[i].Type == E_CRATE)
-			return true;
-	}
-	return false;
+	int obj = ObjectNumber(cellarstate, coord);
+	return obj >= 0 && cellarstate.Objects[obj].Type == E_CRATE;
 }
 
 bool CELLAR::ShelfAt(const CELLAR_STATE& cellarstate, const COORD& coord) const{
-	for(int i=0; i<cellarstate.Objects.size(); i++){
-		if(cellarstate.Objects[i].ObjPos == coord && cellarstate.Objects[i].Type == E_SHELF)
-			return true;
-	}
-	return false;	
+	int obj = ObjectNumber(cellarstate, coord);
+	return obj >= 0 && cellarstate.Objects[obj].Type == E_SHELF;
 }
 
 //Empty if there is no crate, shelf or bottle.
-//TODO: find alternative to avoid checking all objects for position
 bool CELLAR::EmptyTile(const CELLAR_STATE& cellarstate, const COORD& coord) const{
-	bool empty = true;
-	
+	if(!Grid.Inside(coord))
+		return true;
+
 	// If there is a bottle, not empty
-	if(Grid.Inside(coord) && Grid(coord) >= 0 && Grid(coord) < NumBottles)
-		empty = false;
-	//If no bottles but objects, not empty
-	if(empty)
-		for(int i=0; i<cellarstate.Objects.size() && empty; i++){
-			if(cellarstate.Objects[i].ObjPos == coord)
-				empty = false;
-		}
-		
-	return empty;
+	if(Grid(coord) >= 0 && Grid(coord) < NumBottles)
+		return false;
+
+	int cell = Grid.Index(coord);
+	return !(cellarstate.Occupied[cell >> 6] & ((uint64_t) 1 << (cell & 63)));
 }
 
 // Tiles are free if there are no obstacles (bottles are OK)
 bool CELLAR::FreeTile(const CELLAR_STATE& cellarstate, const COORD& coord) const{
-	return ObjectNumber(cellarstate, coord) < 0;
+	if(!Grid.Inside(coord))
+		return true;
+
+	int cell = Grid.Index(coord);
+	return !(cellarstate.Occupied[cell >> 6] & ((uint64_t) 1 << (cell & 63)));
 }
 
 int CELLAR::ObjectNumber(const CELLAR_STATE& cellarstate, const COORD& coord) const{
-	for(int i=0; i<cellarstate.Objects.size(); i++){
-		if(cellarstate.Objects[i].ObjPos == coord)
-			return i;
-	}
-	return -1;
+	if(!Grid.Inside(coord))
+		return -1;
+	return cellarstate.ObjectAt[Grid.Index(coord)];
+}
+
+// Object at coord that may be pushed (active objects only), -1 otherwise
+int CELLAR::ActiveObjectNumber(const CELLAR_STATE& cellarstate, const COORD& coord) const{
+	int obj = ObjectNumber(cellarstate, coord);
+	return (obj >= 0 && cellarstate.Objects[obj].active) ? obj : -1;
+}
+
+// Relocate an object, keeping the cell index and occupancy bits in sync
+void CELLAR::MoveObject(CELLAR_STATE& cellarstate, int obj, const COORD& coord) const{
+	int from = Grid.Index(cellarstate.Objects[obj].ObjPos);
+	int to = Grid.Index(coord);
+	assert(cellarstate.ObjectAt[from] == obj && cellarstate.ObjectAt[to] < 0);
+
+	cellarstate.ObjectAt[from] = -1;
+	cellarstate.Occupied[from >> 6] &= ~((uint64_t) 1 << (from & 63));
+	cellarstate.ObjectAt[to] = obj;
+	cellarstate.Occupied[to >> 6] |= (uint64_t) 1 << (to & 63);
+	cellarstate.Objects[obj].ObjPos = coord;
 }
 /////
 
 int CELLAR::GetObservation(const CELLAR_STATE& cellarstate, int pos, int type) const
 {	 
-    double distance;
     double efficiency;
 	int obs;
 	
     if(type == 1){
-        distance = COORD::EuclideanDistance(cellarstate.AgentPos, BottlePos[pos]);
-        efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+        efficiency = CheckEfficiency(cellarstate.AgentPos, BottlePos[pos]);
             
         if (Bernoulli(efficiency))
             obs = cellarstate.Bottles[pos].Valuable ? E_GOOD : E_BAD;
@@ -1422,8 +1616,7 @@ int CELLAR::GetObservation(const CELLAR_STATE& cellarstate, int pos, int type) c
             obs = cellarstate.Bottles[pos].Valuable ? E_BAD : E_GOOD;
     }
     else{
-        distance = COORD::EuclideanDistance(cellarstate.AgentPos, cellarstate.Objects[pos].ObjPos);
-        efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+        efficiency = CheckEfficiency(cellarstate.AgentPos, cellarstate.Objects[pos].ObjPos);
             
         if (Bernoulli(efficiency))
             obs = cellarstate.Objects[pos].Type == E_CRATE ? E_CRATE : E_SHELF;
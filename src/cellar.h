@@ -83,13 +83,15 @@ public:
 		  bool active;				//activate/deactivate based on value
     };
 	 std::vector<OBJ_ENTRY> Objects;
+	 std::vector<int> ObjectAt;		// Cell index -> object number (-1 if none)
+	 std::vector<uint64_t> Occupied;	// One bit per cell holding an object
     int Target; // Smart knowledge
 	 int CollectedBottles;
 	 
 	 void activateFeature(int feature, bool status);
 };
 
-class CELLAR : public SIMULATOR
+class CELLAR final : public SIMULATOR
 {
 public:
 
@@ -97,11 +99,15 @@ public:
     CELLAR(PROBLEM_PARAMS& problem_params);
 
     virtual STATE* Copy(const STATE& state) const;
+    virtual bool Hash(const STATE& state, std::size_t& hash) const;
+    virtual bool Equal(const STATE& state1, const STATE& state2) const;
     virtual void Validate(const STATE& state) const;
     virtual STATE* CreateStartState() const;
     virtual void FreeState(STATE* state) const;
     virtual bool Step(STATE& state, int action,
         int& observation, double& reward) const;
+    virtual void StepBatch(STATE** states, const int* actions,
+        int* observations, double* rewards, bool* terminal, int n) const;
 
 	/*** Added by JCS to test PGS ***/
 	//Uses regular POMCP Step
@@ -110,11 +116,24 @@ public:
 	//Step with PGS rewards
 	bool StepPGS(STATE& state, int action,
         int& observation, double& reward) const;
+	//Step for rollout level LEVEL, chosen at compile time by the search
+	template <int LEVEL>
+	bool StepLevel(STATE& state, int action,
+        int& observation, double& reward) const
+	{
+	    if (LEVEL >= KNOWLEDGE::PGS)
+	        return StepPGS(state, action, observation, reward);
+	    return StepNormal(state, action, observation, reward);
+	}
 	// Simple Step (transition only)
 	bool SimpleStep(STATE& state, int action) const;
 	//PGS Rollout policy
 	void GeneratePGS(const STATE& state, const HISTORY& history,
         std::vector<int>& legal, const STATUS& status) const;
+	bool RolloutKey(const STATE& state, uint64_t& key) const;
+	bool RolloutHistory() const { return false; } //Rollout policies only read the state
+	void TrimMemory() const { MemoryPool.Trim(); }
+	void DisplayMemory(std::ostream& ostr) const { MemoryPool.DisplayStatistics("State", ostr); }
 	
 	//Compute PGS value
 	double PGS(STATE& state) const;
@@ -133,6 +152,8 @@ public:
         std::vector<int>& legal, const STATUS& status) const;
     virtual bool LocalMove(STATE& state, const HISTORY& history,
         int stepObservation, const STATUS& status) const;
+    virtual bool ConditionedMove(STATE& state, const HISTORY& history,
+        int stepObservation, const STATUS& status) const;
 
     virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
         std::ostream& ostr) const;
@@ -178,7 +199,16 @@ protected:
 	 void Init_Ftest2();
     void Init_7_8();
     void Init_11_11();
+    void InitEfficiency();
+    double CheckEfficiency(const COORD& agent, const COORD& target) const
+    {
+        return Efficiency(std::abs(agent.X - target.X), std::abs(agent.Y - target.Y));
+    }
     int GetObservation(const CELLAR_STATE& cellarstate, int pos, int type) const;
+    void UpdateBottleCheck(CELLAR_STATE& cellarstate, int bottle,
+        int observation, double efficiency) const;
+    void UpdateObjectCheck(CELLAR_STATE& cellarstate, int obj,
+        int observation, double efficiency) const;
     int SelectTarget(const CELLAR_STATE& cellarstate) const;
 	 
 	 bool CrateAt(const CELLAR_STATE& cellarstate, const COORD& coord) const;
@@ -186,6 +216,8 @@ protected:
 	 bool EmptyTile(const CELLAR_STATE& cellarstate, const COORD& coord) const;
 	 bool FreeTile(const CELLAR_STATE& cellarstate, const COORD& coord) const;
 	 int ObjectNumber(const CELLAR_STATE& cellarstate, const COORD& coord) const;
+	 int ActiveObjectNumber(const CELLAR_STATE& cellarstate, const COORD& coord) const;
+	 void MoveObject(CELLAR_STATE& cellarstate, int obj, const COORD& coord) const;
 
     GRID<int> Grid;
     std::vector<COORD> BottlePos;
@@ -194,11 +226,14 @@ protected:
 	 int E_OBJCHECK, E_BOTTLECHECK, E_OBJPUSH, E_BOTTLEPUSH, E_BPUSHNORTH, E_BPUSHSOUTH, E_BPUSHEAST, E_BPUSHWEST, E_PUSHNORTH, E_PUSHSOUTH, E_PUSHEAST, E_PUSHWEST, E_SAMPLE; //Markers for the beginning of action group
     COORD StartPos;
     double HalfEfficiencyDistance;
+    GRID<double> Efficiency; // Sensor efficiency by (|dx|, |dy|) to the target
     double SmartMoveProb;
     int UncertaintyCount;
 	double BIN_ENTROPY_LIMIT; //0.5 or set to preference
+	double EntropyBound; //p <= EntropyBound or p >= 1 - EntropyBound satisfies BIN_ENTROPY_LIMIT
 	double ACTIVATION_THRESHOLD;
     double PGSAlpha;
+    double RewardCheck; // Check action punishment, for Step and StepBatch
 
 private:
 
@@ -70,6 +70,8 @@ DRONE::DRONE(PROBLEM_PARAMS& problem_params){
     BIN_ENTROPY_LIMIT = params.entropy;
     ///Feature activation threshold
     ACTIVATION_THRESHOLD = params.activation;
+    ///Sample creature movement on demand
+    Lazy = params.lazy;
 
     //Setup problem with parameters
     Grid = GRID<int>(Size, Size);
@@ -101,6 +103,12 @@ DRONE::DRONE(PROBLEM_PARAMS& problem_params){
         Init_5_8_8();
     else
         InitGeneral();
+
+    if (Lazy)
+        InitWalkTables();
+
+    InitEfficiency();
+    EntropyBound = BinaryEntropyBound(BIN_ENTROPY_LIMIT);
 }
 
 DRONE::DRONE(int size, int creatures, int trees, int targets, bool useTable)
@@ -143,6 +151,7 @@ DRONE::DRONE(int size, int creatures, int trees, int targets, bool useTable)
     ///Determines when a probability estimate (with Binomial distribution) is 'safe'
     BIN_ENTROPY_LIMIT = 0.4;
     ACTIVATION_THRESHOLD = -16;
+    Lazy = false;
     //RandomSeed(0);
 
     if (size == 3 && creatures == 3 && trees == 0)
@@ -155,6 +164,9 @@ DRONE::DRONE(int size, int creatures, int trees, int targets, bool useTable)
         Init_5_8_8();
     else
         InitGeneral();
+
+    InitEfficiency();
+    EntropyBound = BinaryEntropyBound(BIN_ENTROPY_LIMIT);
 }
 
 void DRONE::Init_3_3(){
@@ -303,6 +315,7 @@ STATE* DRONE::CreateStartState() const
     droneState->AgentPos = StartPos;
     droneState->TargetPhotosTaken = 0;
     droneState->NoTargetPhotosTaken = 0;
+    droneState->Time = 0;
     droneState->Features.clear();
     //droneState->Rooms.clear();
 
@@ -329,6 +342,7 @@ STATE* DRONE::CreateStartState() const
         entry.measured = 0;
         entry.count = 0;
         entry.active = true;
+        entry.LastUpdate = 0;
 
         droneState->Features.push_back(entry);
     }
@@ -376,12 +390,17 @@ STATE* DRONE::CreateStartState() const
         entry.measured = 0;
         entry.count = 0;
         entry.active = true;
+        entry.LastUpdate = 0;
 
         droneState->Features.push_back(entry);
     }
 
     assert(droneState->Features.size() == NumFeatures);
 
+    droneState->CellHead.assign(NumCells, -1);
+    for (int i = 0; i < NumFeatures; i++)
+        LinkFeature(*droneState, i);
+
     return droneState;
 }
 
@@ -469,11 +488,15 @@ bool DRONE::StepNormal(STATE& state, int action,
 
     ///Setup environmental state transition
     //Move everything (movable) with probability and update their positionProbs
-    for(int i=0; i<NumFeatures; i++) {
-        if(i < NumCreatures)
-            MoveFeature(droneState, i);
-        //Update the prob of everything, including trees
-        droneState.Features[i].ProbPosition *= (1 - PROB_MOVING);
+    if (Lazy)
+        droneState.Time++; //Deferred until queried, see Materialize
+    else {
+        for(int i=0; i<NumFeatures; i++) {
+            if(i < NumCreatures)
+                MoveFeature(droneState, i);
+            //Update the prob of everything, including trees
+            droneState.Features[i].ProbPosition *= (1 - PROB_MOVING);
+        }
     }
 
     if (action < A_LEAVE) // move & wait
@@ -543,6 +566,7 @@ bool DRONE::StepNormal(STATE& state, int action,
         int cell = action - E_CHECK;
 
         assert(cell < NumCells);
+        MaterializeCell(droneState, cell);
         observation = Observe(droneState, cell); // O_EMPTY, O_FEATURE...O_FEATURE+NumFeatures
         //droneState.Rooms[cell].measured++;
 
@@ -550,11 +574,8 @@ bool DRONE::StepNormal(STATE& state, int action,
 
         if (featureN >= 0) //Observed something
         {
-            double distance = COORD::EuclideanDistance(droneState.AgentPos, Grid.Coord(cell));
-            double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
-
             droneState.Features[featureN].ObservedPosition = Grid.Coord(cell);
-            droneState.Features[featureN].ProbPosition = efficiency;
+            droneState.Features[featureN].ProbPosition = CheckEfficiency(droneState.AgentPos, Grid.Coord(cell));
         }
 
         reward += reward_check;
@@ -565,6 +586,7 @@ bool DRONE::StepNormal(STATE& state, int action,
     if(action >= E_IDENTIFY && action < E_PHOTO){
         //Identify feature
         int feature = action - E_IDENTIFY;
+        Materialize(droneState, feature);
 
         //cout << "UCB: Attempting to identify feature " << feature << endl;
         ///Attempting to ID needs at least an 'idea' of the feature's location
@@ -640,6 +662,7 @@ bool DRONE::StepNormal(STATE& state, int action,
 
         ///Succeed only if taking a picture directly above a real target
         int feature = action - E_PHOTO;
+        Materialize(droneState, feature);
         if(FeatureAt(droneState, feature, droneState.AgentPos)){
             droneState.Features[feature].numPhotos++; //Photo successful
 
@@ -711,8 +734,10 @@ void DRONE::MoveFeature(DRONE_STATE &droneState, int feature) const {
         int newY = droneState.Features[feature].Position.Y + y;
 
         if (newX >= 0 && newX < Size && newY >= 0 && newY < Size && EmptyCell(droneState, COORD(newX, newY))) {
+            UnlinkFeature(droneState, feature);
             droneState.Features[feature].Position.X = newX;
             droneState.Features[feature].Position.Y = newY;
+            LinkFeature(droneState, feature);
         }
     }
 
@@ -740,6 +765,7 @@ bool DRONE::LocalMove(STATE& state, const HISTORY& history,
         return false;
 
     //And move if possible
+    Materialize(droneState, feature);
     MoveFeature(droneState, feature);
 
     //cout << "Local move: " << endl;
@@ -752,6 +778,7 @@ bool DRONE::LocalMove(STATE& state, const HISTORY& history,
     if(action >= E_CHECK && action < E_IDENTIFY){
         int cell = action - E_CHECK;
         int realObs = history.Back().Observation;
+        MaterializeCell(droneState, cell);
         int newObs = Observe(droneState, cell);
 
         //Check the same cell and see if observations match
@@ -789,6 +816,82 @@ bool DRONE::LocalMove(STATE& state, const HISTORY& history,
     return true;
 }
 
+//Constructive version of LocalMove
+//Only proposes features whose flip is consistent with their known type, weighted
+//by the likelihood of the last identify/photo observation. Cell checks depend on
+//the random creature move and are still validated afterwards.
+bool DRONE::ConditionedMove(STATE& state, const HISTORY& history,
+                             int stepObs, const STATUS& status) const
+{
+    DRONE_STATE& droneState = safe_cast<DRONE_STATE&>(state);
+    int action = history.Back().Action;
+    int realObs = history.Back().Observation;
+
+    //Feature whose observation depends on its target status
+    int observed = -1;
+    if (action >= E_IDENTIFY && action < E_PHOTO)
+        observed = action - E_IDENTIFY;
+    else if (action >= E_PHOTO)
+        observed = action - E_PHOTO;
+
+    //Likelihood of the real observation for each target status of the observed feature
+    double likelihood[2] = {1.0, 1.0};
+    if (observed >= 0) {
+        for (int target = 0; target < 2; target++) {
+            int obs = target ? O_TARGET : O_NOTARGET;
+            if (action < E_PHOTO)
+                likelihood[target] = (obs == realObs) ? RECOGNITION_RATE : 1.0 - RECOGNITION_RATE;
+            else
+                likelihood[target] = (obs == realObs) ? 1.0 : 0.0;
+        }
+    }
+
+    static thread_local std::vector<double> weights;
+    weights.resize(NumFeatures);
+    double total = 0.0;
+    for (int f = 0; f < NumFeatures; f++) {
+        const DRONE_STATE::P_ENTRY& entry = droneState.Features[f];
+        bool flipped = !entry.Target;
+        //Changing target status of known creatures is not a valid belief
+        if ((entry.ProbTarget == 0 && flipped) || (entry.ProbTarget == 1 && !flipped))
+            weights[f] = 0.0;
+        else if (f == observed)
+            weights[f] = likelihood[flipped];
+        else
+            weights[f] = observed >= 0 ? likelihood[droneState.Features[observed].Target] : 1.0;
+        total += weights[f];
+    }
+    //Accept at the rate of rejection sampling over the largest likelihood,
+    //so that states explaining the observation badly are not over-represented
+    if (total <= 0 || !Bernoulli(total / (NumFeatures * std::max(likelihood[0], likelihood[1]))))
+        return false;
+
+    //Pick the first feature with positive weight where the running sum reaches r
+    int feature = -1;
+    double r = RandomDouble(0, total);
+    for (int f = 0; f < NumFeatures; f++) {
+        if (weights[f] > 0) {
+            feature = f;
+            r -= weights[f];
+            if (r <= 0) break;
+        }
+    }
+
+    droneState.Features[feature].Target = !(droneState.Features[feature].Target);
+    Materialize(droneState, feature);
+    MoveFeature(droneState, feature);
+
+    //CHECK: validate location observations
+    if(action >= E_CHECK && action < E_IDENTIFY){
+        int cell = action - E_CHECK;
+        MaterializeCell(droneState, cell);
+        if(Observe(droneState, cell) != realObs)
+            return false;
+    }
+
+    return true;
+}
+
 /* Fast PGS for Rollout policy
  * Simplified PGS point count by using only the specific action changes
  */
@@ -1048,7 +1151,6 @@ void DRONE::GeneratePreferred(const STATE& state, const HISTORY& history,
 
     //Process the people in the room
     int person;
-    int room = Grid.Index(pose);
     bool roomPhoto = false;
     bool identify = false;
 
@@ -1074,7 +1176,7 @@ void DRONE::GeneratePreferred(const STATE& state, const HISTORY& history,
            droneState.Features[person].ObservedPosition == pose &&
            !roomPhoto) {
             roomPhoto = true; //Add action only once
-            actions.push_back(E_PHOTO + room);
+            actions.push_back(E_PHOTO + person);
         }
     }
 
@@ -1149,69 +1251,150 @@ bool DRONE::FeatureAt(const DRONE_STATE &droneState, int feature, const COORD &c
 }
 
 /*
- * Find out whether a room contains at least one target
+ * Features sharing a cell form a list through NextInCell, sorted by decreasing
+ * feature number so the head is the feature reported by a cell check
  * */
-bool DRONE::TargetIn(const DRONE_STATE &droneState, int cell) const {
+void DRONE::LinkFeature(DRONE_STATE &droneState, int feature) const {
+    int* link = &droneState.CellHead[Grid.Index(droneState.Features[feature].Position)];
+    while (*link > feature)
+        link = &droneState.Features[*link].NextInCell;
+    droneState.Features[feature].NextInCell = *link;
+    *link = feature;
+}
+
+void DRONE::UnlinkFeature(DRONE_STATE &droneState, int feature) const {
+    int* link = &droneState.CellHead[Grid.Index(droneState.Features[feature].Position)];
+    while (*link != feature) {
+        assert(*link >= 0);
+        link = &droneState.Features[*link].NextInCell;
+    }
+    *link = droneState.Features[feature].NextInCell;
+}
+
+/*
+ * Lazy movement: bring a feature's position up to the current time
+ * */
+void DRONE::Materialize(DRONE_STATE &droneState, int feature) const {
+    DRONE_STATE::P_ENTRY& entry = droneState.Features[feature];
+    int steps = droneState.Time - entry.LastUpdate;
+    if (steps == 0)
+        return;
+
+    entry.LastUpdate = droneState.Time;
+    entry.ProbPosition *= pow(1 - PROB_MOVING, steps);
+    if (feature >= NumCreatures) //Trees don't move
+        return;
+
+    //Blocked if the destination is taken, as in MoveFeature
+    COORD pos(SampleWalk(entry.Position.X, steps), SampleWalk(entry.Position.Y, steps));
+    if (pos != entry.Position && EmptyCell(droneState, pos)) {
+        UnlinkFeature(droneState, feature);
+        entry.Position = pos;
+        LinkFeature(droneState, feature);
+    }
+}
+
+/*
+ * Lazy movement: update every creature that could have walked into the cell
+ * */
+void DRONE::MaterializeCell(DRONE_STATE &droneState, int cell) const {
+    if (!Lazy)
+        return;
+
     COORD coord = Grid.Coord(cell);
-    bool found = false;
+    for (int i = 0; i < NumCreatures; i++) {
+        const DRONE_STATE::P_ENTRY& entry = droneState.Features[i];
+        int steps = droneState.Time - entry.LastUpdate;
+        if (steps > 0 && COORD::ManhattanDistance(entry.Position, coord) <= steps)
+            Materialize(droneState, i);
+    }
+}
+
+/*
+ * Multi-step distribution of one coordinate under MoveFeature's random walk.
+ * Each axis moves +1 or -1 with prob. PROB_MOVING/4 per step and stays put at
+ * the border.  Both axes are sampled independently, which ignores that a
+ * creature moves along only one of them per step and any collisions on the way.
+ * */
+const int DRONE::LazyHorizon;
+
+void DRONE::InitWalkTables() {
+    double p = (int) (PROB_MOVING * 100) / 400.0; //Same rounding as MoveFeature
+    std::vector<double> dist(Size), next(Size);
+
+    WalkCDF.resize(LazyHorizon * Size * Size);
+    for (int x = 0; x < Size; x++) {
+        std::fill(dist.begin(), dist.end(), 0.0);
+        dist[x] = 1.0;
+        for (int k = 0; k < LazyHorizon; k++) {
+            std::fill(next.begin(), next.end(), 0.0);
+            for (int y = 0; y < Size; y++) {
+                next[y] += dist[y] * (1 - 2 * p);
+                next[y + 1 < Size ? y + 1 : y] += dist[y] * p;
+                next[y > 0 ? y - 1 : y] += dist[y] * p;
+            }
+            dist.swap(next);
 
-    for(int i=0; i < droneState.Features.size() && !found; i++) {
-        if (droneState.Features[i].Position == coord && droneState.Features[i].Target){ //Person in room
-            found = true;
+            double* cdf = &WalkCDF[(k * Size + x) * Size];
+            double total = 0.0;
+            for (int y = 0; y < Size; y++) {
+                total += dist[y];
+                cdf[y] = total;
+            }
         }
     }
-    return found;
+}
+
+int DRONE::SampleWalk(int x, int steps) const {
+    while (steps > 0) {
+        int k = std::min(steps, LazyHorizon);
+        const double* cdf = &WalkCDF[((k - 1) * Size + x) * Size];
+        x = std::upper_bound(cdf, cdf + Size - 1, RandomDouble(0, 1)) - cdf;
+        steps -= k;
+    }
+    return x;
+}
+
+/*
+ * Find out whether a room contains at least one target
+ * */
+bool DRONE::TargetIn(const DRONE_STATE &droneState, int cell) const {
+    for (int i = droneState.CellHead[cell]; i >= 0; i = droneState.Features[i].NextInCell) {
+        if (droneState.Features[i].Target) //Person in room
+            return true;
+    }
+    return false;
 }
 
 /*
  * Feature ID currently in cell, or empty
  * */
 int DRONE::FeatureInCell(const DRONE_STATE &droneState, int cell) const {
-    COORD coord = Grid.Coord(cell);
-    return FeatureInCoord(droneState, coord);
+    int feature = droneState.CellHead[cell];
+    return feature >= 0 ? O_FEATURE + feature : O_EMPTY;
 }
 
 int DRONE::FeatureInCoord(const DRONE_STATE &droneState, const COORD& coord) const {
-    int feature = O_EMPTY;
-
-    for (int i = 0; i < droneState.Features.size(); i++){
-        if (droneState.Features[i].Position == coord)
-            feature = O_FEATURE + i;
-    }
-
-    return feature;
+    return FeatureInCell(droneState, Grid.Index(coord));
 }
 
 void DRONE::PeopleInCurrentRoom(const DRONE_STATE &droneState, std::vector<int>& people) const {
     people.clear();
 
-    COORD coord = droneState.AgentPos;
-
-    for (int i = 0; i < droneState.Features.size(); i++){
-        if (droneState.Features[i].Position == coord)
-            people.push_back(i);
-    }
+    int cell = Grid.Index(droneState.AgentPos);
+    for (int i = droneState.CellHead[cell]; i >= 0; i = droneState.Features[i].NextInCell)
+        people.push_back(i);
+    std::reverse(people.begin(), people.end());
 }
 
-//TODO: find alternative to avoid checking all objects for position
 bool DRONE::EmptyCell(const DRONE_STATE &droneState, const COORD &coord) const {
-    bool empty = true;
-
-    // If there is anything, not empty
-    for (int i = 0; i < droneState.Features.size() && empty; i++){
-        if (droneState.Features[i].Position == coord)
-            empty = false;
-    }
-
-    return empty;
+    return droneState.CellHead[Grid.Index(coord)] < 0;
 }
 
 int DRONE::NumPeopleInRoom(const DRONE_STATE &droneState, const COORD &coord) const {
     int nPeople = 0;
-    for (int i = 0; i < droneState.Features.size(); i++){
-        if (droneState.Features[i].Position == coord)
-            nPeople++;
-    }
+    for (int i = droneState.CellHead[Grid.Index(coord)]; i >= 0; i = droneState.Features[i].NextInCell)
+        nPeople++;
     return nPeople;
 }
 
@@ -1245,13 +1428,8 @@ int DRONE::Identify(const DRONE_STATE &droneState, int feature) const {
  * */
 int DRONE::Observe(const DRONE_STATE &droneState, int cell) const
 {
-    double distance;
-    double efficiency;
     int obs;
-    COORD coord = Grid.Coord(cell);
-
-    distance = COORD::EuclideanDistance(droneState.AgentPos, coord);
-    efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+    double efficiency = CheckEfficiency(droneState.AgentPos, Grid.Coord(cell));
     int trueObs = FeatureInCell(droneState, cell);
 
     if(Bernoulli(efficiency)){ //Correct reading
@@ -1271,8 +1449,17 @@ int DRONE::Observe(const DRONE_STATE &droneState, int cell) const
  * Return whether value p satisfies the entropy restriction < 0.5 in a Bernoulli distribution
  * */
 bool DRONE::BinEntropyCheck(double p) const {
-    double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);
-    return (binaryEntropy <= DRONE::BIN_ENTROPY_LIMIT);
+    return LowEntropy(p, EntropyBound);
+}
+
+void DRONE::InitEfficiency() {
+    //Sensor efficiency only depends on the offset to the checked cell
+    Efficiency.Resize(Size, Size);
+    for (int x = 0; x < Size; ++x)
+        for (int y = 0; y < Size; ++y) {
+            double distance = COORD::EuclideanDistance(COORD(0, 0), COORD(x, y));
+            Efficiency(x, y) = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+        }
 }
 
 void DRONE::DisplayBeliefs(const BELIEF_STATE& beliefState,
@@ -27,10 +27,12 @@ struct DRONE_PARAMS : PROBLEM_PARAMS{
     double recognition = 0.9;
     double moving = 0.25;
     double entropy = 0.4;
+    bool lazy = false; //Move creatures only when queried (planning only)
 
     DRONE_PARAMS() : size(3), creatures(3), trees(3), targets(3),
                     maxPhotos(1), photos(1), activation(-16), discount(0.95),
-                    fDiscount(0.3), recognition(0.9), moving(0.25), entropy(0.4){}
+                    fDiscount(0.3), recognition(0.9), moving(0.25), entropy(0.4),
+                    lazy(false){}
 };
 
 class DRONE_STATE : public STATE
@@ -41,6 +43,7 @@ public:
     int NoTargetPhotosTaken;
     int PhotosTaken;
     int Battery;
+    int Time; //Steps simulated, for lazy creature movement
 
     //Each entry has a prob. of being Big Foot
     struct P_ENTRY
@@ -63,13 +66,18 @@ public:
         int count;
         //Relevance
         bool active;
+        //Spatial index
+        int NextInCell; //Next feature in the same cell (-1 if last)
+        //Lazy movement
+        int LastUpdate; //Time at which Position was last sampled
     };
     std::vector<P_ENTRY> Features;
+    std::vector<int> CellHead; //Highest-numbered feature in each cell (-1 if empty)
 
     void activateFeature(int feature, bool status);
 };
 
-class DRONE : public SIMULATOR
+class DRONE final : public SIMULATOR
 {
 public:
 
@@ -90,6 +98,15 @@ public:
     //Step with PGS rewards
     bool StepPGS(STATE& state, int action,
                  int& observation, double& reward) const;
+    //Step for rollout level LEVEL, chosen at compile time by the search
+    template <int LEVEL>
+    bool StepLevel(STATE& state, int action,
+                 int& observation, double& reward) const
+    {
+        if (LEVEL >= KNOWLEDGE::PGS)
+            return StepPGS(state, action, observation, reward);
+        return StepNormal(state, action, observation, reward);
+    }
     // Simple Step (transition only)
     bool SimpleStep(STATE& state, int action) const;
     //PGS Rollout policy
@@ -114,6 +131,11 @@ public:
                            std::vector<int>& legal, const STATUS& status) const;
     virtual bool LocalMove(STATE& state, const HISTORY& history,
                            int stepObservation, const STATUS& status) const;
+    virtual bool ConditionedMove(STATE& state, const HISTORY& history,
+                                 int stepObservation, const STATUS& status) const;
+    virtual bool RolloutHistory() const { return false; } //Rollout policies only read the state
+    virtual void TrimMemory() const { MemoryPool.Trim(); }
+    virtual void DisplayMemory(std::ostream& ostr) const { MemoryPool.DisplayStatistics("State", ostr); }
 
     virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
                                 std::ostream& ostr) const;
@@ -161,6 +183,16 @@ protected:
     int Observe(const DRONE_STATE &droneState, int cell) const;
     int Identify(const DRONE_STATE &droneState, int feature) const;
     void MoveFeature(DRONE_STATE &droneState, int feature) const;
+    void LinkFeature(DRONE_STATE &droneState, int feature) const;
+    void UnlinkFeature(DRONE_STATE &droneState, int feature) const;
+    void Materialize(DRONE_STATE &droneState, int feature) const;
+    void MaterializeCell(DRONE_STATE &droneState, int cell) const;
+    void InitWalkTables();
+    void InitEfficiency();
+    double CheckEfficiency(const COORD& agent, const COORD& cell) const {
+        return Efficiency(std::abs(agent.X - cell.X), std::abs(agent.Y - cell.Y));
+    }
+    int SampleWalk(int x, int steps) const;
     int IdentifyRoom(const DRONE_STATE &droneState, int room) const;
     int SelectTarget(const DRONE_STATE& droneState) const;
 
@@ -187,6 +219,7 @@ protected:
     double RECOGNITION_RATE; //0.0 - 1.0 recognition rate for identifier
     double PROB_MOVING;
     double BIN_ENTROPY_LIMIT; //0.5 or set to preference
+    double EntropyBound; //p <= EntropyBound or p >= 1 - EntropyBound satisfies BIN_ENTROPY_LIMIT
     double ACTIVATION_THRESHOLD;
 
     struct P_INFO{
@@ -200,6 +233,15 @@ protected:
     COORD StartPos;
     std::vector<COORD> FeaturePos; //Keep track of people
     double HalfEfficiencyDistance;
+    GRID<double> Efficiency; //Sensor efficiency by (|dx|, |dy|) to the checked cell
+
+    /*
+     * Lazy movement: creatures are only moved when their position is queried,
+     * by sampling the random walk over all the steps since their last update
+     * */
+    bool Lazy;
+    static const int LazyHorizon = 16; //Longest precomputed walk
+    std::vector<double> WalkCDF; //Per-axis walk CDF, indexed [steps-1][from][to]
 
 private:
 
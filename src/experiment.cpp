@@ -23,12 +23,14 @@ EXPERIMENT::PARAMS::PARAMS()
 
 EXPERIMENT::EXPERIMENT(const SIMULATOR& real,
     const SIMULATOR& simulator, const string& outputFile,
-    EXPERIMENT::PARAMS& expParams, MCTS::PARAMS& searchParams)
+    EXPERIMENT::PARAMS& expParams, MCTS::PARAMS& searchParams,
+    MCTS::FACTORY createSearch)
 :   Real(real),
     Simulator(simulator),
     OutputFile(outputFile.c_str()),
     ExpParams(expParams),
-    SearchParams(searchParams)
+    SearchParams(searchParams),
+    CreateSearch(createSearch)
 {
     if (ExpParams.AutoExploration){
         SearchParams.ExplorationConstant = simulator.GetRewardRange();
@@ -52,7 +54,7 @@ void EXPERIMENT::Run()
 
     STATE* state = Real.CreateStartState();
     SearchParams.startstate = state;
-    MCTS * mcts = new MCTS(Simulator, SearchParams);
+    MCTS * mcts = CreateSearch(Simulator, SearchParams);
 	
     if (SearchParams.Verbose >= 1){
 		  cout << "Real start state:" << endl;
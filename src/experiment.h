@@ -52,7 +52,8 @@ public:
 
     EXPERIMENT(const SIMULATOR& real, const SIMULATOR& simulator, 
         const std::string& outputFile, 
-        EXPERIMENT::PARAMS& expParams, MCTS::PARAMS& searchParams);
+        EXPERIMENT::PARAMS& expParams, MCTS::PARAMS& searchParams,
+        MCTS::FACTORY createSearch = &MCTS::Create<SIMULATOR>);
 
     void Run();
     void MultiRun();
@@ -65,6 +66,7 @@ private:
     const SIMULATOR& Simulator;
     EXPERIMENT::PARAMS& ExpParams;
     MCTS::PARAMS& SearchParams;
+    MCTS::FACTORY CreateSearch;
     RESULTS Results;
 
     std::ofstream OutputFile;
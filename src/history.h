@@ -21,11 +21,15 @@ public:
         int Observation;
     };
     
+    HISTORY()
+    :   Length(0)
+    { }
+
     bool operator==(const HISTORY& history) const
     {
-        if (history.History.size() != History.size())
+        if (history.Length != Length)
             return false;
-        for (int i = 0; i < History.size(); ++i)
+        for (int i = 0; i < Length; ++i)
             if (history.History[i].Action != History[i].Action
              || history.History[i].Observation != History[i].Observation)
                 return false;
@@ -34,56 +38,77 @@ public:
     
     void Add(int action, int obs = -1) 
     { 
-        History.push_back(ENTRY(action, obs));
+        if (Length == (int) History.size())
+            History.push_back(ENTRY(action, obs));
+        else
+            History[Length] = ENTRY(action, obs);
+        Length++;
+    }
+
+    // Make room for n entries in total, so that Append can be used
+    void Reserve(int n)
+    {
+        if ((int) History.size() < n)
+            History.resize(n);
+    }
+
+    // Add within the reserved capacity, without growing the buffer
+    void Append(int action, int obs)
+    {
+        assert(Length < (int) History.size());
+        History[Length++] = ENTRY(action, obs);
     }
     
     void Pop()
     {
-        History.pop_back();
+        assert(Length > 0);
+        Length--;
     }
     
+    // Entries past t are kept as spare capacity
     void Truncate(int t)
     {
-        History.resize(t);
+        assert(t >= 0 && t <= Length);
+        Length = t;
     }
     
     void Clear() 
     { 
-        History.clear(); 
+        Length = 0;
     }
     
     int Size() const
     {
-        return History.size();
+        return Length;
     }
     
     ENTRY& operator[](int t)
     {
-        assert(t >= 0 && t < History.size());
+        assert(t >= 0 && t < Length);
         return History[t];
     }
 
     const ENTRY& operator[](int t) const
     {
-        assert(t >= 0 && t < History.size());
+        assert(t >= 0 && t < Length);
         return History[t];
     }
 
     ENTRY& Back()
     {
-        assert(History.size() > 0);
-        return History.back();
+        assert(Length > 0);
+        return History[Length - 1];
     }
 
     const ENTRY& Back() const
     {
-        assert(History.size() > 0);
-        return History.back();
+        assert(Length > 0);
+        return History[Length - 1];
     }
 
     void Display(std::ostream& ostr) const
     {
-        for (int t = 0; t < History.size(); ++t)
+        for (int t = 0; t < Length; ++t)
         {
             ostr << "a=" << History[t].Action <<  " ";
             if (History[t].Observation >= 0)
@@ -95,6 +120,7 @@ public:
 private:
 
     std::vector<ENTRY> History;
+    int Length;
 };
 
 #endif // HISTORY
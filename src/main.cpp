@@ -43,9 +43,25 @@ int main(int argc, char* argv[])
 
     searchParams.Verbose = cl.verbose;
     searchParams.useFtable = cl.fTable;
+    searchParams.NumThreads = cl.threads;
+    searchParams.PinThreads = cl.pinThreads;
+    searchParams.ConstructiveTransforms = cl.constructive;
+    searchParams.MaxNodeParticles = cl.nodeParticles;
+    searchParams.LazyBeliefs = cl.lazyBeliefs;
+    searchParams.ShareParticles = cl.shareParticles;
+    searchParams.MaxNodes = cl.maxNodes;
+    searchParams.PruneTree = cl.pruneTree;
+    searchParams.TrimMemory = cl.trimMemory;
+    searchParams.Interleave = cl.interleave;
+    searchParams.AsyncSimulations = cl.asyncSimulations;
+
+    // Pools take these when they allocate their first chunk
+    MEMORY_POOL_SETTINGS::ChunkSize() = cl.poolChunk;
+    MEMORY_POOL_SETTINGS::HugePages() = cl.hugePages;
 
     knowledge.TreeLevel = cl.treeKnowledge;
     knowledge.RolloutLevel = cl.rolloutKnowledge;
+    knowledge.CachePGS = cl.pgsCache;
     
     if(cl.problem == "none")
     {
@@ -55,12 +71,14 @@ int main(int argc, char* argv[])
 
     SIMULATOR* real = 0;
     SIMULATOR* simulator = 0;
+    MCTS::FACTORY createSearch = 0;
     string description;
 
     if (problem == "rocksample")
     {
         real = new ROCKSAMPLE(size, number);
         simulator = new ROCKSAMPLE(size, number);
+        createSearch = &MCTS::Create<ROCKSAMPLE>;
         description = "rocksample[" + std::to_string(size) + "," + std::to_string(number) + "]";
     }    
     else if(inputfile == "none"){
@@ -72,13 +90,17 @@ int main(int argc, char* argv[])
         if(!PARSER::parseCellarFile(problem_params, inputfile)) return 1;
         real = new CELLAR(problem_params);
         simulator = new CELLAR(problem_params);        
+        createSearch = &MCTS::Create<CELLAR>;
         description = problem_params.description;
     }
     else if (problem == "drone"){
         DRONE_PARAMS problem_params;
         if(!PARSER::parseDroneFile(problem_params, inputfile)) return 1;
-        real = new DRONE(problem_params);
+        DRONE_PARAMS real_params = problem_params;
+        real_params.lazy = false; //The real world moves every creature
+        real = new DRONE(real_params);
         simulator = new DRONE(problem_params);
+        createSearch = &MCTS::Create<DRONE>;
         description = problem_params.description;
     }
     else if (problem == "mobipick"){
@@ -86,6 +108,7 @@ int main(int argc, char* argv[])
         if(!PARSER::parseMobipickFile(problem_params, inputfile)) return 1;
         real = new MOBIPICK(problem_params);
         simulator = new MOBIPICK(problem_params);
+        createSearch = &MCTS::Create<MOBIPICK>;
         description = problem_params.description;
     }
 	else{
@@ -114,7 +137,11 @@ int main(int argc, char* argv[])
 	//cout << "Tree level: " << knowledge.TreeLevel << endl;
 
     simulator->SetKnowledge(knowledge);
-    EXPERIMENT experiment(*real, *simulator, outputfile, expParams, searchParams);
+    simulator->SetStepLatency(cl.stepLatency);
+    // The search through virtual simulator calls works for any domain
+    if (cl.genericSearch)
+        createSearch = &MCTS::Create<SIMULATOR>;
+    EXPERIMENT experiment(*real, *simulator, outputfile, expParams, searchParams, createSearch);
     experiment.DiscountedReturn();
 
     delete real;
@@ -1,7 +1,12 @@
 #include "mcts.h"
+#include "rocksample.h"
+#include "cellar.h"
+#include "drone.h"
+#include "mobipick.h"
 #include <math.h>
 
 #include <algorithm>
+#include <atomic>
 #include <iomanip>
 
 using namespace std;
@@ -18,14 +23,31 @@ MCTS::PARAMS::PARAMS()
     MaxAttempts(0),
     ExpandCount(1),
     ExplorationConstant(1),
-    DisableTree(false)
+    DisableTree(false),
+    NumThreads(1),
+    PinThreads(false),
+    ConstructiveTransforms(false),
+    MaxNodeParticles(0),
+    LazyBeliefs(false),
+    ShareParticles(false),
+    MaxNodes(0),
+    PruneTree(false),
+    TrimMemory(false),
+    Interleave(1),
+    AsyncSimulations(0)
 {
 }
 
-MCTS::MCTS(const SIMULATOR& simulator, const PARAMS& params)
+template <class DOMAIN>
+MCTS_SEARCH<DOMAIN>::MCTS_SEARCH(const DOMAIN& simulator, const PARAMS& params)
 :   Simulator(simulator),
     Params(params),
-    TreeDepth(0)
+    TreeDepth(0),
+    Workers(0),
+    RolloutHistory(simulator.RolloutHistory()),
+    NumPrunes(0),
+    NumPrunedNodes(0),
+    NumSkippedExpansions(0)
 {
     VNODE::NumChildren = Simulator.GetNumActions();
     QNODE::NumChildren = Simulator.GetNumObservations();
@@ -37,14 +59,20 @@ MCTS::MCTS(const SIMULATOR& simulator, const PARAMS& params)
 		state = Simulator.CreateStartState();
 	 
     Root = ExpandNode(state);
+
+    if (Params.NumThreads > 1)
+        Workers = new THREAD_POOL(Params.NumThreads, Params.PinThreads);
 	
 		if (Params.Verbose >= 1){
 			cout << "Simulator start state:" << endl;
 			Simulator.DisplayState(*state, cout);
 		}
 
-    for (int i = 0; i < Params.NumStartStates; i++)
-        Root->Beliefs().AddSample(Simulator.CreateStartState());
+    // A lazy root draws start states as simulations need them
+    if (Params.LazyBeliefs)
+        Root->Beliefs().SetGenerative(true);
+    else for (int i = 0; i < Params.NumStartStates; i++)
+        Root->Beliefs().AddSample(Simulator.CreateStartState(), Simulator);
 		
 	/*** Incremental refinement ***/
 	if(Params.useFtable){
@@ -59,13 +87,17 @@ MCTS::MCTS(const SIMULATOR& simulator, const PARAMS& params)
 	
 }
 
-MCTS::~MCTS()
+template <class DOMAIN>
+MCTS_SEARCH<DOMAIN>::~MCTS_SEARCH()
 {
+    Arena.Clear(Simulator);
     VNODE::Free(Root, Simulator);
     VNODE::FreeAll();
+    delete Workers;
 }
 
-bool MCTS::Update(int action, int observation, double reward)
+template <class DOMAIN>
+bool MCTS_SEARCH<DOMAIN>::Update(int action, int observation, double reward)
 {
     History.Add(action, observation);
     BELIEF_STATE beliefs;
@@ -76,8 +108,10 @@ bool MCTS::Update(int action, int observation, double reward)
     if (vnode)
     {
         if (Params.Verbose >= 1)
-            cout << "Matched " << vnode->Beliefs().GetNumSamples() << " states" << endl;        
-        beliefs.Copy(vnode->Beliefs(), Simulator);
+            cout << "Matched " << vnode->Beliefs().GetNumParticles() << " states ("
+                << vnode->Beliefs().GetNumSamples() << " unique)" << endl;
+        // Take ownership of the matched particles, the old tree is freed below
+        beliefs.Move(vnode->Beliefs(), Simulator);
     }
     else
     {
@@ -90,7 +124,7 @@ bool MCTS::Update(int action, int observation, double reward)
         AddTransforms(Root, beliefs);
     
     // If we still have no particles, fail
-    if (beliefs.Empty() && (!vnode || vnode->Beliefs().Empty()))
+    if (beliefs.Empty())
         return false;
 
     if (Params.Verbose >= 2)
@@ -105,26 +139,34 @@ bool MCTS::Update(int action, int observation, double reward)
 		beliefRevision(beliefs);
 	 
     // Find a state to initialise prior (only requires fully observed state)
-    const STATE* state = 0;
-    if (vnode && !vnode->Beliefs().Empty())
-        state = vnode->Beliefs().GetSample(0);
-    else
-        state = beliefs.GetSample(0);	 
+    const STATE* state = beliefs.GetSample(0);
 
-    // Delete old tree and create new root
+    // Delete old tree and create new root, dropping its particles at once
+    Arena.Clear(Simulator);
     VNODE::Free(Root, Simulator);
+    if (Params.TrimMemory)
+    {
+        VNODE::TrimPool();
+        Simulator.TrimMemory();
+    }
     VNODE* newRoot = ExpandNode(state);
-    newRoot->Beliefs() = beliefs;
+    newRoot->Beliefs().Move(beliefs, Simulator);
     Root = newRoot;
     return true;
 }
 
-int MCTS::SelectAction()
+template <class DOMAIN>
+int MCTS_SEARCH<DOMAIN>::SelectAction()
 {
-    if (Params.DisableTree)
-        RolloutSearch();
+    int level = Simulator.GetKnowledge().RolloutLevel;
+    if (level >= SIMULATOR::KNOWLEDGE::PGS)
+        SearchLevel<SIMULATOR::KNOWLEDGE::PGS>();
+    else if (level >= SIMULATOR::KNOWLEDGE::SMART)
+        SearchLevel<SIMULATOR::KNOWLEDGE::SMART>();
+    else if (level >= SIMULATOR::KNOWLEDGE::LEGAL)
+        SearchLevel<SIMULATOR::KNOWLEDGE::LEGAL>();
     else
-        UCTSearch();
+        SearchLevel<SIMULATOR::KNOWLEDGE::PURE>();
 
     int action;
 
@@ -139,13 +181,57 @@ int MCTS::SelectAction()
     return action;
 }
 
-void MCTS::RolloutSearch()
+template <class DOMAIN>
+template <int LEVEL>
+void MCTS_SEARCH<DOMAIN>::SearchLevel()
+{
+    bool verbose = Params.Verbose >= 2;
+    if (Params.useFtable)
+    {
+        if (verbose)
+            Search<LEVEL, true, true>();
+        else
+            Search<LEVEL, true, false>();
+    }
+    else
+    {
+        if (verbose)
+            Search<LEVEL, false, true>();
+        else
+            Search<LEVEL, false, false>();
+    }
+}
+
+template <class DOMAIN>
+template <int LEVEL, bool FTABLE, bool VERBOSE>
+void MCTS_SEARCH<DOMAIN>::Search()
+{
+    if (Params.DisableTree)
+        RolloutSearch<LEVEL, FTABLE, VERBOSE>();
+    else if (Params.AsyncSimulations > 0)
+        UCTSearchAsync<LEVEL, FTABLE, VERBOSE>();
+    else if (Params.Interleave > 1)
+        UCTSearchInterleaved<LEVEL, FTABLE, VERBOSE>();
+    else
+        UCTSearch<LEVEL, FTABLE, VERBOSE>();
+}
+
+template <class DOMAIN>
+template <int LEVEL, bool FTABLE, bool VERBOSE>
+void MCTS_SEARCH<DOMAIN>::RolloutSearch()
 {
 	std::vector<double> totals(Simulator.GetNumActions(), 0.0);
 	int historyDepth = History.Size();
 	std::vector<int> legal;
-	assert(BeliefState().GetNumSamples() > 0);
-	Simulator.GenerateLegal(*BeliefState().GetSample(0), GetHistory(), legal, GetStatus());
+	assert(!BeliefState().Empty());
+	if (BeliefState().IsGenerative())
+	{
+		STATE* sample = BeliefState().CreateSample(Simulator);
+		Simulator.GenerateLegal(*sample, GetHistory(), legal, GetStatus());
+		Simulator.FreeState(sample);
+	}
+	else
+		Simulator.GenerateLegal(*BeliefState().GetSample(0), GetHistory(), legal, GetStatus());
 	random_shuffle(legal.begin(), legal.end());
 
 	REWARD delayedReward;
@@ -158,7 +244,7 @@ void MCTS::RolloutSearch()
 
 		int observation;
 		double immediateReward, totalReward, totalFReward;
-		bool terminal = Simulator.Step(*state, action, observation, immediateReward);
+		bool terminal = Simulator.template StepLevel<LEVEL>(*state, action, observation, immediateReward);
 
 		VNODE*& vnode = Root->Child(action).Child(observation);
 		if (!vnode && !terminal)
@@ -168,14 +254,14 @@ void MCTS::RolloutSearch()
 		}
 		History.Add(action, observation);
 
-		delayedReward = Rollout(*state);
+		delayedReward = Rollout<LEVEL, VERBOSE>(*state);
 		totalReward = immediateReward + Simulator.GetDiscount() * delayedReward.V;
 		totalFReward = immediateReward + Simulator.GetFDiscount() * delayedReward.F;
 
 		Root->Child(action).Value.Add(totalReward);
 
 		//NOTE: F-table update
-		if(Params.useFtable && !terminal)
+		if(FTABLE && !terminal)
 			ftable.valueUpdate(action, totalFReward);
 
 		Simulator.FreeState(state);
@@ -183,7 +269,9 @@ void MCTS::RolloutSearch()
 	}
 }
 
-void MCTS::UCTSearch()
+template <class DOMAIN>
+template <int LEVEL, bool FTABLE, bool VERBOSE>
+void MCTS_SEARCH<DOMAIN>::UCTSearch()
 {
     ClearStatistics();
     int historyDepth = History.Size();
@@ -193,7 +281,7 @@ void MCTS::UCTSearch()
         STATE* state = Root->Beliefs().CreateSample(Simulator);
         Simulator.Validate(*state);
         Status.Phase = SIMULATOR::STATUS::TREE;
-        if (Params.Verbose >= 2)
+        if (VERBOSE)
         {
             cout << "Starting simulation" << endl;
             Simulator.DisplayState(*state, cout);
@@ -201,55 +289,369 @@ void MCTS::UCTSearch()
 
         TreeDepth = 0;
         PeakTreeDepth = 0;
-        REWARD reward = SimulateV(*state, Root);
+        REWARD reward = Simulate<LEVEL, FTABLE, VERBOSE>(*state, Root);
         double totalReward = reward.V;
         StatTotalReward.Add(totalReward);
         StatTreeDepth.Add(PeakTreeDepth);
 		  
-        if (Params.Verbose >= 2)
+        if (VERBOSE)
             cout << "Total reward = " << totalReward << endl;
-        if (Params.Verbose >= 3)
+        if (VERBOSE && Params.Verbose >= 3)
             DisplayValue(4, cout);
 
         Simulator.FreeState(state);
         History.Truncate(historyDepth);
+
+        // Nodes on the simulated path are only safe to free between simulations
+        if (Params.PruneTree && TreeFull())
+            Prune();
     }
 
     DisplayStatistics(cout);
 }
 
-MCTS::REWARD MCTS::SimulateV(STATE &state, VNODE *vnode)
+/*
+    Advances Params.Interleave simulations round-robin, one tree step at a
+    time, and prefetches the next node of each and its action array
+    (VNODE::Prefetch) before moving on to the next, so that cache misses
+    of one descent overlap with the work of the others. Simulations see
+    the statistics of those still in flight only after their backup, so
+    results differ from the sequential search.
+*/
+template <class DOMAIN>
+template <int LEVEL, bool FTABLE, bool VERBOSE>
+void MCTS_SEARCH<DOMAIN>::UCTSearchInterleaved()
 {
-    int action = GreedyUCB(vnode, true);
+    ClearStatistics();
+    int historyDepth = History.Size();
+    vector<SIMULATION> simulations(Params.Interleave);
+    for (int i = 0; i < (int) simulations.size(); ++i)
+        simulations[i].History = History;
+    int started = 0, finished = 0;
+    bool draining = false;
 
-    REWARD reward;
+    while (finished < Params.NumSimulations)
+    {
+        int active = 0;
+        for (int i = 0; i < (int) simulations.size(); ++i)
+        {
+            SIMULATION& simulation = simulations[i];
+            if (!simulation.State && started < Params.NumSimulations && !draining)
+            {
+                StartSimulation<VERBOSE>(simulation);
+                started++;
+            }
+            if (simulation.State)
+                active++;
+        }
 
-    PeakTreeDepth = TreeDepth;
-    if (TreeDepth >= Params.MaxDepth) // search horizon reached
-        return reward;
+        // Nodes on the paths in flight are only safe to free once all have finished
+        if (!active)
+        {
+            Prune();
+            draining = false;
+            continue;
+        }
 
-    if (TreeDepth == 1)
-        AddSample(vnode, state);
+        for (int i = 0; i < (int) simulations.size(); ++i)
+        {
+            SIMULATION& simulation = simulations[i];
+            if (!simulation.State)
+                continue;
+
+            SwapSimulation(simulation);
+            REWARD reward;
+            bool leaf = Descend<LEVEL, FTABLE, VERBOSE>(*simulation.State, simulation.Node, reward);
+            if (leaf)
+            {
+                Backup<FTABLE>(reward);
+                StatTotalReward.Add(reward.V);
+                StatTreeDepth.Add(PeakTreeDepth);
+                if (VERBOSE)
+                    cout << "Total reward = " << reward.V << endl;
+                History.Truncate(historyDepth);
+                Path.clear();
+            }
+            SwapSimulation(simulation);
+
+            if (leaf)
+            {
+                Simulator.FreeState(simulation.State);
+                simulation.State = 0;
+                finished++;
+                if (Params.PruneTree && TreeFull())
+                    draining = true;
+            }
+            else
+                simulation.Node->Prefetch();
+        }
+    }
 
-    QNODE& qnode = vnode->Child(action);
-    reward = SimulateQ(state, qnode, action);
+    DisplayStatistics(cout);
+}
 
-    vnode->Value.Add(reward.V);
-    
+/*
+    Keeps Params.AsyncSimulations simulations in flight for simulators
+    whose steps complete asynchronously (SIMULATOR::BeginStep). Tree and
+    rollout steps of each simulation are started in turn, and a
+    simulation resumes once its step is done, so the latency of one step
+    is spent on the steps of the others. As with the interleaved search,
+    results differ from the sequential search.
+*/
+template <class DOMAIN>
+template <int LEVEL, bool FTABLE, bool VERBOSE>
+void MCTS_SEARCH<DOMAIN>::UCTSearchAsync()
+{
+    ClearStatistics();
+    int historyDepth = History.Size();
+    vector<SIMULATION> simulations(Params.AsyncSimulations);
+    for (int i = 0; i < (int) simulations.size(); ++i)
+        simulations[i].History = History;
+    int started = 0, finished = 0;
+    bool draining = false;
+
+    while (finished < Params.NumSimulations)
+    {
+        int active = 0;
+        bool progress = false;
+        for (int i = 0; i < (int) simulations.size(); ++i)
+        {
+            SIMULATION& simulation = simulations[i];
+            if (!simulation.State && started < Params.NumSimulations && !draining)
+            {
+                StartSimulation<VERBOSE>(simulation);
+                started++;
+            }
+            if (!simulation.State)
+                continue;
+            active++;
+            if (simulation.Pending && !simulation.Step.Done)
+                continue;
+
+            // Run on as long as steps complete at once
+            progress = true;
+            SwapSimulation(simulation);
+            bool done;
+            while (!(done = AdvanceAsync<LEVEL, FTABLE, VERBOSE>(simulation)) && simulation.Step.Done)
+                ;
+            if (done)
+            {
+                History.Truncate(historyDepth);
+                Path.clear();
+            }
+            SwapSimulation(simulation);
+
+            if (done)
+            {
+                Simulator.FreeState(simulation.State);
+                simulation.State = 0;
+                finished++;
+                if (Params.PruneTree && TreeFull())
+                    draining = true;
+            }
+        }
+
+        // Nodes on the paths in flight are only safe to free once all have finished
+        if (!active)
+        {
+            Prune();
+            draining = false;
+        }
+        else if (!progress)
+            Simulator.WaitSteps();
+    }
+
+    DisplayStatistics(cout);
+}
+
+// Continue a simulation of the asynchronous search after its last step
+// completed, up to its next step. Returns true once it has been backed up.
+template <class DOMAIN>
+template <int LEVEL, bool FTABLE, bool VERBOSE>
+bool MCTS_SEARCH<DOMAIN>::AdvanceAsync(SIMULATION& simulation)
+{
+    SIMULATOR::ASYNC_STEP& step = simulation.Step;
+    if (simulation.Pending)
+    {
+        simulation.Pending = false;
+        if (simulation.InRollout)
+        {
+            if (RolloutHistory)
+                History.Append(step.Action, step.Observation);
+            if (VERBOSE && Params.Verbose >= 4)
+            {
+                Simulator.DisplayAction(step.Action, cout);
+                Simulator.DisplayObservation(*step.State, step.Observation, cout);
+                Simulator.DisplayReward(step.Reward, cout);
+                Simulator.DisplayState(*step.State, cout);
+            }
+            simulation.RolloutReward += step.Reward * simulation.RolloutDiscount;
+            simulation.RolloutDiscount *= Simulator.GetDiscount();
+            simulation.RolloutSteps++;
+            simulation.RolloutTerminal = step.Terminal;
+        }
+        else
+        {
+            int next = CompleteStep<VERBOSE>(*simulation.State, simulation.Node,
+                step.Action, step.Observation, step.Reward, step.Terminal);
+            if (next == STEP_LEAF)
+                return FinishAsync<FTABLE, VERBOSE>(REWARD());
+            if (next == STEP_ROLLOUT)
+            {
+                Status.Phase = SIMULATOR::STATUS::ROLLOUT;
+                if (VERBOSE && Params.Verbose >= 3)
+                    cout << "Starting rollout" << endl;
+                if (RolloutHistory)
+                    History.Reserve(History.Size() + std::max(Params.MaxDepth - TreeDepth, 0));
+                simulation.InRollout = true;
+                simulation.RolloutReward = 0;
+                simulation.RolloutDiscount = 1;
+                simulation.RolloutSteps = 0;
+                simulation.RolloutTerminal = false;
+            }
+        }
+    }
+
+    if (simulation.InRollout)
+    {
+        if (simulation.RolloutSteps + TreeDepth >= Params.MaxDepth || simulation.RolloutTerminal)
+        {
+            simulation.InRollout = false;
+            StatRolloutDepth.Add(simulation.RolloutSteps);
+            if (VERBOSE && Params.Verbose >= 3)
+                cout << "Ending rollout after " << simulation.RolloutSteps
+                    << " steps, with total reward " << simulation.RolloutReward << endl;
+            REWARD reward;
+            reward.V = simulation.RolloutReward;
+            return FinishAsync<FTABLE, VERBOSE>(reward);
+        }
+        step.Action = SIMULATOR::SelectRandom<LEVEL>(Simulator, *simulation.State, History, Status);
+    }
+    else if (!SelectStep(*simulation.State, simulation.Node, step.Action))
+        return FinishAsync<FTABLE, VERBOSE>(REWARD());
+
+    step.State = simulation.State;
+    simulation.Pending = true;
+    Simulator.BeginStep(step);
+    return false;
+}
+
+template <class DOMAIN>
+template <bool FTABLE, bool VERBOSE>
+bool MCTS_SEARCH<DOMAIN>::FinishAsync(REWARD reward)
+{
+    Backup<FTABLE>(reward);
+    StatTotalReward.Add(reward.V);
+    StatTreeDepth.Add(PeakTreeDepth);
+    if (VERBOSE)
+        cout << "Total reward = " << reward.V << endl;
+    return true;
+}
+
+template <class DOMAIN>
+template <bool VERBOSE>
+void MCTS_SEARCH<DOMAIN>::StartSimulation(SIMULATION& simulation)
+{
+    simulation.State = Root->Beliefs().CreateSample(Simulator);
+    Simulator.Validate(*simulation.State);
+    simulation.Node = Root;
+    simulation.Status = Status;
+    simulation.Status.Phase = SIMULATOR::STATUS::TREE;
+    simulation.TreeDepth = 0;
+    simulation.PeakTreeDepth = 0;
+    simulation.Path.clear();
+    simulation.Pending = false;
+    simulation.InRollout = false;
+    simulation.Step.Done = true;
+    if (VERBOSE)
+    {
+        cout << "Starting simulation" << endl;
+        Simulator.DisplayState(*simulation.State, cout);
+    }
+}
+
+// Exchange the search state with that of a simulation in flight
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::SwapSimulation(SIMULATION& simulation)
+{
+    std::swap(History, simulation.History);
+    std::swap(Path, simulation.Path);
+    std::swap(Status, simulation.Status);
+    std::swap(TreeDepth, simulation.TreeDepth);
+    std::swap(PeakTreeDepth, simulation.PeakTreeDepth);
+}
+
+// Descend from vnode to a leaf, recording the path, evaluate the leaf
+// and back the rewards up the path
+template <class DOMAIN>
+template <int LEVEL, bool FTABLE, bool VERBOSE>
+MCTS::REWARD MCTS_SEARCH<DOMAIN>::Simulate(STATE &state, VNODE *vnode)
+{
+    REWARD reward;
+    int treeDepth = TreeDepth;
+    Path.clear();
+
+    while (!Descend<LEVEL, FTABLE, VERBOSE>(state, vnode, reward))
+        ;
+    Backup<FTABLE>(reward);
+
+    TreeDepth = treeDepth;
     return reward;
 }
 
-MCTS::REWARD MCTS::SimulateQ(STATE &state, QNODE &qnode, int action)
+// One step of the descent from vnode. Returns true once the leaf was
+// evaluated into reward, otherwise vnode is moved to the child.
+template <class DOMAIN>
+template <int LEVEL, bool FTABLE, bool VERBOSE>
+bool MCTS_SEARCH<DOMAIN>::Descend(STATE &state, VNODE *&vnode, REWARD &reward)
 {
+    int action;
+    if (!SelectStep(state, vnode, action))
+        return true;
+
     int observation;
-    REWARD reward, delayedReward;
     double immediateReward = 0;
+    bool terminal = Simulator.template StepLevel<LEVEL>(state, action, observation, immediateReward);
+    int next = CompleteStep<VERBOSE>(state, vnode, action, observation, immediateReward, terminal);
+    if (next == STEP_ROLLOUT)
+        reward = Rollout<LEVEL, VERBOSE>(state);
+    return next != STEP_DESCEND;
+}
+
+// Choose the action at vnode, false if the search horizon is reached
+template <class DOMAIN>
+bool MCTS_SEARCH<DOMAIN>::SelectStep(STATE &state, VNODE *vnode, int &action)
+{
+    action = GreedyUCB(vnode, true);
 
-    bool terminal = Simulator.Step(state, action, observation, immediateReward);
+    PeakTreeDepth = TreeDepth;
+    if (TreeDepth >= Params.MaxDepth) // search horizon reached
+        return false;
+
+    if (TreeDepth == 1)
+        AddSample(vnode, state);
+    return true;
+}
+
+// Record the outcome of the step taken at vnode and expand its child.
+// Returns STEP_DESCEND with vnode moved to the child, STEP_LEAF after a
+// terminal step or STEP_ROLLOUT if the rest is to be estimated by a rollout.
+template <class DOMAIN>
+template <bool VERBOSE>
+int MCTS_SEARCH<DOMAIN>::CompleteStep(STATE &state, VNODE *&vnode, int action,
+    int observation, double immediateReward, bool terminal)
+{
     assert(observation >= 0 && observation < Simulator.GetNumObservations());
     History.Add(action, observation);
-
-    if (Params.Verbose >= 3)
+    PATH_STEP step;
+    step.Node = vnode;
+    step.Action = action;
+    step.Observation = observation;
+    step.ImmediateReward = immediateReward;
+    step.Terminal = terminal;
+    Path.push_back(step);
+
+    if (VERBOSE && Params.Verbose >= 3)
     {
         Simulator.DisplayAction(action, cout);
         Simulator.DisplayObservation(state, observation, cout);
@@ -257,34 +659,52 @@ MCTS::REWARD MCTS::SimulateQ(STATE &state, QNODE &qnode, int action)
         Simulator.DisplayState(state, cout);
     }
 
-    VNODE*& vnode = qnode.Child(observation);
-    if (!vnode && !terminal && qnode.Value.GetCount() >= Params.ExpandCount)
-        vnode = ExpandNode(&state);
+    if (terminal)
+        return STEP_LEAF;
 
-    if (!terminal)
+    QNODE& qnode = vnode->Child(action);
+    VNODE*& child = qnode.Child(observation);
+    if (!child && qnode.Value.GetCount() >= Params.ExpandCount)
     {
-        TreeDepth++;
-        if (vnode)
-            delayedReward = SimulateV(state, vnode);
+        if (TreeFull())
+            NumSkippedExpansions++;
         else
-            delayedReward = Rollout(state);
-        TreeDepth--;
+            child = ExpandNode(&state);
     }
 
-    reward.V = immediateReward + Simulator.GetDiscount() * delayedReward.V;
-    reward.F = immediateReward + Simulator.GetFDiscount() * delayedReward.F;
-    qnode.Value.Add(reward.V);
-	 
-	//Update (f,a) value in f-table using discounted return F
-	if(Params.useFtable && !terminal)
-		ftable.valueUpdate(action, reward.F);
+    TreeDepth++;
+    if (!child)
+        return STEP_ROLLOUT;
+    vnode = child;
+    return STEP_DESCEND;
+}
 
-    return reward;
+template <class DOMAIN>
+template <bool FTABLE>
+void MCTS_SEARCH<DOMAIN>::Backup(REWARD &reward)
+{
+    for (int i = (int) Path.size() - 1; i >= 0; --i)
+    {
+        const PATH_STEP& step = Path[i];
+        reward.V = step.ImmediateReward + Simulator.GetDiscount() * reward.V;
+        step.Node->Child(step.Action).Value.Add(reward.V);
+
+        //Update (f,a) value in f-table using discounted return F
+        if (FTABLE)
+        {
+            reward.F = step.ImmediateReward + Simulator.GetFDiscount() * reward.F;
+            if (!step.Terminal)
+                ftable.valueUpdate(step.Action, reward.F);
+        }
+
+        step.Node->Value.Add(reward.V);
+    }
 }
 
 /*** Activate/deactivate objects in all beliefs ***/
 //TODO: Determine activation policy
-void MCTS::beliefRevision(BELIEF_STATE& beliefs){	
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::beliefRevision(BELIEF_STATE& beliefs){	
 	std::vector<double> fvalues;
 	ftable.getAllFValues(fvalues);
 	float FTABLE_INACTIVE = ftable.getACTIVATION_THRESHOLD();
@@ -305,12 +725,12 @@ void MCTS::beliefRevision(BELIEF_STATE& beliefs){
 	for(int i=0; i < fvalues.size(); i++) {
 	    allOff = allOff && (fvalues[i] < FTABLE_INACTIVE);
         if (fvalues[i] < FTABLE_INACTIVE){
-            beliefs.activateFeature(i, false);
+            beliefs.activateFeature(i, false, Simulator);
             ftable.toggleActionsForFeature(i, false);
             if(Params.Verbose >= 1) cout << "Feature " << i << " is now OFF" << endl;
         }
         else{
-            beliefs.activateFeature(i, true);
+            beliefs.activateFeature(i, true, Simulator);
             ftable.toggleActionsForFeature(i, true);
             if(Params.Verbose >= 1) cout << "Feature " << i << " is now ON" << endl;
         }
@@ -319,7 +739,7 @@ void MCTS::beliefRevision(BELIEF_STATE& beliefs){
     ///If all features are off, activate one random feature (to get address estimation errors)
     if(allOff){
         int f = Random(fvalues.size());
-        beliefs.activateFeature(f, true);
+        beliefs.activateFeature(f, true, Simulator);
         ftable.toggleActionsForFeature(f, true);
         if(Params.Verbose >= 1) cout << "Feature " << f << " is back ON" << endl;
     }
@@ -328,11 +748,12 @@ void MCTS::beliefRevision(BELIEF_STATE& beliefs){
 	fvalues.clear();
 }
 
-VNODE* MCTS::ExpandNode(const STATE* state)
+template <class DOMAIN>
+VNODE* MCTS_SEARCH<DOMAIN>::ExpandNode(const STATE* state)
 {
     VNODE* vnode = VNODE::Create();
     vnode->Value.Set(0, 0);
-    Simulator.Prior(state, History, vnode, Status);
+    SIMULATOR::Prior(Simulator, state, History, vnode, Status);
 
     if (Params.Verbose >= 2)
     {
@@ -344,21 +765,88 @@ VNODE* MCTS::ExpandNode(const STATE* state)
     return vnode;
 }
 
-void MCTS::AddSample(VNODE* node, const STATE& state)
+namespace
 {
-    STATE* sample = Simulator.Copy(state);
-    node->Beliefs().AddSample(sample);
+    struct PRUNE_CANDIDATE
+    {
+        int Count, Depth;
+        VNODE** Slot;
+
+        // Least visited first, deeper first among equals so that a
+        // subtree is never freed before its own candidates
+        bool operator<(const PRUNE_CANDIDATE& other) const
+        {
+            return Count != other.Count ? Count < other.Count : Depth > other.Depth;
+        }
+    };
+
+    void CollectCandidates(VNODE* vnode, int depth, std::vector<PRUNE_CANDIDATE>& candidates)
+    {
+        for (int action = 0; action < VNODE::NumChildren; action++)
+        {
+            QNODE& qnode = vnode->Child(action);
+            for (int observation = 0; observation < QNODE::NumChildren; observation++)
+            {
+                VNODE*& child = qnode.Child(observation);
+                if (!child)
+                    continue;
+                // Children of the root hold the particles for the next belief
+                if (depth > 0)
+                {
+                    PRUNE_CANDIDATE candidate = { child->Value.GetCount(), depth + 1, &child };
+                    candidates.push_back(candidate);
+                }
+                CollectCandidates(child, depth + 1, candidates);
+            }
+        }
+    }
+}
+
+// Free the least visited subtrees, which also drops rarely observed
+// observation branches, until the tree is back to 3/4 of the budget
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::Prune()
+{
+    std::vector<PRUNE_CANDIDATE> candidates;
+    CollectCandidates(Root, 0, candidates);
+    std::sort(candidates.begin(), candidates.end());
+
+    int target = Params.MaxNodes - Params.MaxNodes / 4;
+    int before = VNODE::GetNumAllocated();
+    for (int i = 0; i < (int) candidates.size() && VNODE::GetNumAllocated() > target; ++i)
+    {
+        VNODE::Free(*candidates[i].Slot, Simulator);
+        *candidates[i].Slot = 0;
+    }
+
+    NumPrunes++;
+    NumPrunedNodes += before - VNODE::GetNumAllocated();
+    if (Params.Verbose >= 2)
+        cout << "Pruned " << before - VNODE::GetNumAllocated() << " of "
+            << before << " nodes" << endl;
+}
+
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::AddSample(VNODE* node, const STATE& state)
+{
+    if (Params.ShareParticles && node->Beliefs().Empty())
+        node->Beliefs().SetArena(&Arena);
+    if (Params.MaxNodeParticles > 0)
+        node->Beliefs().AddSampleReservoir(state, Simulator, Params.MaxNodeParticles);
+    else
+        node->Beliefs().AddSampleCopy(state, Simulator);
     if (Params.Verbose >= 2)
     {
         cout << "Adding sample:" << endl;
-        Simulator.DisplayState(*sample, cout);
+        Simulator.DisplayState(state, cout);
     }
 }
 
 /*
   Relevance UCB is F-aware: Use only actions that apply to active features or according to rollout policy
 */
-int MCTS::RelevanceUCB(VNODE *vnode, bool ucb) const
+template <class DOMAIN>
+int MCTS_SEARCH<DOMAIN>::RelevanceUCB(VNODE *vnode, bool ucb) const
 {
     static vector<int> besta;
     besta.clear();
@@ -419,7 +907,8 @@ int MCTS::RelevanceUCB(VNODE *vnode, bool ucb) const
     return besta[Random(besta.size())];
 }
 
-int MCTS::GreedyUCB(VNODE* vnode, bool ucb) const
+template <class DOMAIN>
+int MCTS_SEARCH<DOMAIN>::GreedyUCB(VNODE* vnode, bool ucb) const
 {
     static vector<int> besta;
     besta.clear();
@@ -461,10 +950,12 @@ int MCTS::GreedyUCB(VNODE* vnode, bool ucb) const
     return besta[Random(besta.size())];
 }
 
-MCTS::REWARD MCTS::Rollout(STATE &state)
+template <class DOMAIN>
+template <int LEVEL, bool VERBOSE>
+MCTS::REWARD MCTS_SEARCH<DOMAIN>::Rollout(STATE &state)
 {
     Status.Phase = SIMULATOR::STATUS::ROLLOUT;
-    if (Params.Verbose >= 3)
+    if (VERBOSE && Params.Verbose >= 3)
         cout << "Starting rollout" << endl;
 
     REWARD rewardSt;
@@ -475,16 +966,22 @@ MCTS::REWARD MCTS::Rollout(STATE &state)
     double f_discount = 1.0;
     bool terminal = false;
     int numSteps;
+
+    // Room for the whole rollout, so steps never grow the history
+    if (RolloutHistory)
+        History.Reserve(History.Size() + std::max(Params.MaxDepth - TreeDepth, 0));
+
     for (numSteps = 0; numSteps + TreeDepth < Params.MaxDepth && !terminal; ++numSteps)
     {
         int observation;
         double reward;
 
-        int action = Simulator.SelectRandom(state, History, Status);
-        terminal = Simulator.Step(state, action, observation, reward);
-        History.Add(action, observation);
+        int action = SIMULATOR::SelectRandom<LEVEL>(Simulator, state, History, Status);
+        terminal = Simulator.template StepLevel<LEVEL>(state, action, observation, reward);
+        if (RolloutHistory)
+            History.Append(action, observation);
 
-        if (Params.Verbose >= 4)
+        if (VERBOSE && Params.Verbose >= 4)
         {
             Simulator.DisplayAction(action, cout);
             Simulator.DisplayObservation(state, observation, cout);
@@ -499,50 +996,129 @@ MCTS::REWARD MCTS::Rollout(STATE &state)
     rewardSt.V = totalReward;
 
     StatRolloutDepth.Add(numSteps);
-    if (Params.Verbose >= 3)
+    if (VERBOSE && Params.Verbose >= 3)
         cout << "Ending rollout after " << numSteps
             << " steps, with total reward " << totalReward << endl;
     return rewardSt;
 }
 
-void MCTS::AddTransforms(VNODE* root, BELIEF_STATE& beliefs)
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::AddTransforms(VNODE* root, BELIEF_STATE& beliefs)
 {
     int attempts = 0, added = 0;
 
     // Local transformations of state that are consistent with history
-    while (added < Params.NumTransforms && attempts < Params.MaxAttempts)
+    if (Workers)
+        AddTransformsParallel(beliefs, attempts, added);
+    else
     {
-        STATE* transform = CreateTransform();
-
-        if (transform)
+        vector<STATE*> transforms;
+        while (added < Params.NumTransforms && attempts < Params.MaxAttempts)
         {
-            beliefs.AddSample(transform);
-            added++;
+            int count = std::min(TransformBatch, std::min(Params.NumTransforms - added,
+                Params.MaxAttempts - attempts));
+            transforms.clear();
+            CreateTransforms(count, transforms);
+            for (int i = 0; i < (int) transforms.size(); ++i)
+                beliefs.AddSample(transforms[i], Simulator);
+            added += transforms.size();
+            attempts += count;
         }
-        attempts++;
     }
 
     if (Params.Verbose >= 1)
     {
         cout << "Created " << added << " local transformations out of "
-            << attempts << " attempts" << endl;
+            << attempts << " attempts";
+        if (added > 0)
+            cout << " (acceptance " << 100.0 * added / attempts << "%, "
+                << (double) attempts / added << " attempts per particle)";
+        cout << endl;
     }    
 }
 
-STATE* MCTS::CreateTransform() const
+// Every thread draws batches of transforms with its own RNG stream (seeded
+// from the main one) into a private list; shared counters stop all threads
+// once enough transforms were accepted. Results are merged on this thread.
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::AddTransformsParallel(BELIEF_STATE& beliefs, int& attempts, int& added)
 {
-    int stepObs;
-    double stepReward;
-    
-    STATE* state = Root->Beliefs().CreateSample(Simulator);
-    Simulator.Step(*state, History.Back().Action, stepObs, stepReward);
-    if (Simulator.LocalMove(*state, History, stepObs, Status))
-        return state;
-    
-    Simulator.FreeState(state);
-    return 0;
+    int numThreads = Workers->GetNumThreads();
+    vector<vector<STATE*> > transforms(numThreads);
+    vector<int> threadAttempts(numThreads, 0);
+    vector<unsigned int> seeds(numThreads);
+    for (int i = 0; i < numThreads; ++i)
+        seeds[i] = Rand();
+
+    std::atomic<int> claimed(0), accepted(0);
+    Root->Beliefs().PrepareSampling();
+    {
+        Workers->Run([&](int thread)
+        {
+            SetThreadSeed(&seeds[thread]);
+            vector<STATE*> batch;
+            while (accepted.load(std::memory_order_relaxed) < Params.NumTransforms)
+            {
+                int count = std::min(TransformBatch,
+                    Params.NumTransforms - accepted.load(std::memory_order_relaxed));
+                int first = claimed.fetch_add(count, std::memory_order_relaxed);
+                if (first >= Params.MaxAttempts)
+                    break;
+                count = std::min(count, Params.MaxAttempts - first);
+
+                batch.clear();
+                CreateTransforms(count, batch);
+                threadAttempts[thread] += count;
+                for (int i = 0; i < (int) batch.size(); ++i)
+                {
+                    if (accepted.fetch_add(1, std::memory_order_relaxed) < Params.NumTransforms)
+                        transforms[thread].push_back(batch[i]);
+                    else
+                        Simulator.FreeState(batch[i]);
+                }
+            }
+            SetThreadSeed(0);
+        });
+    }
+
+    for (int i = 0; i < numThreads; ++i)
+    {
+        attempts += threadAttempts[i];
+        for (int j = 0; j < (int) transforms[i].size(); ++j)
+        {
+            beliefs.AddSample(transforms[i][j], Simulator);
+            added++;
+        }
+    }
 }
 
+// Sample count particles from the root, step them together with the last
+// action and keep those that survive the local move
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::CreateTransforms(int count, vector<STATE*>& transforms) const
+{
+    vector<STATE*> states(count);
+    vector<int> actions(count, History.Back().Action), observations(count);
+    vector<double> rewards(count);
+
+    for (int i = 0; i < count; ++i)
+        states[i] = Root->Beliefs().CreateSample(Simulator);
+    Simulator.StepBatch(&states[0], &actions[0], &observations[0], &rewards[0], 0, count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        bool valid = Params.ConstructiveTransforms
+            ? Simulator.ConditionedMove(*states[i], History, observations[i], Status)
+            : Simulator.LocalMove(*states[i], History, observations[i], Status);
+        if (valid)
+            transforms.push_back(states[i]);
+        else
+            Simulator.FreeState(states[i]);
+    }
+}
+
+template <class DOMAIN>
+const int MCTS_SEARCH<DOMAIN>::TransformBatch;
 double MCTS::UCB[UCB_N][UCB_n];
 bool MCTS::InitialisedFastUCB = true;
 
@@ -559,7 +1135,8 @@ void MCTS::InitFastUCB(double exploration)
     InitialisedFastUCB = true;
 }
 
-inline double MCTS::FastUCB(int N, int n, double logN) const
+template <class DOMAIN>
+inline double MCTS_SEARCH<DOMAIN>::FastUCB(int N, int n, double logN) const
 {
     if (InitialisedFastUCB && N < UCB_N && n < UCB_n)
         return UCB[N][n];
@@ -570,20 +1147,42 @@ inline double MCTS::FastUCB(int N, int n, double logN) const
         return Params.ExplorationConstant * sqrt(logN / n);
 }
 
-void MCTS::ClearStatistics()
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::ClearStatistics()
 {
     StatTreeDepth.Clear();
     StatRolloutDepth.Clear();
     StatTotalReward.Clear();
+    NumPrunes = 0;
+    NumPrunedNodes = 0;
+    NumSkippedExpansions = 0;
+    if (Simulator.GetPGSCache())
+        Simulator.GetPGSCache()->ClearStatistics();
 }
 
-void MCTS::DisplayStatistics(ostream& ostr) const
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::DisplayStatistics(ostream& ostr) const
 {
     if (Params.Verbose >= 1)
     {
         StatTreeDepth.Print("Tree depth", ostr);
         StatRolloutDepth.Print("Rollout depth", ostr);
         StatTotalReward.Print("Total reward", ostr);
+
+        const PGS_CACHE* cache = Simulator.GetPGSCache();
+        if (cache)
+            ostr << "PGS cache: " << cache->GetHits() << " hits, "
+                << cache->GetMisses() << " misses (hit rate "
+                << 100.0 * cache->GetHitRate() << "%), "
+                << cache->GetRejects() << " rejected" << endl;
+
+        if (Params.MaxNodes > 0)
+            ostr << "Tree nodes: " << VNODE::GetNumAllocated() << " of "
+                << Params.MaxNodes << ", pruned " << NumPrunes << " times ("
+                << NumPrunedNodes << " nodes), " << NumSkippedExpansions
+                << " expansions skipped" << endl;
+        VNODE::DisplayPool(ostr);
+        Simulator.DisplayMemory(ostr);
     }
 
     if (Params.Verbose >= 2)
@@ -595,16 +1194,24 @@ void MCTS::DisplayStatistics(ostream& ostr) const
     }
 }
 
-void MCTS::DisplayValue(int depth, ostream& ostr) const
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::DisplayValue(int depth, ostream& ostr) const
 {
     HISTORY history;
     ostr << "MCTS Values:" << endl;
     Root->DisplayValue(history, depth, ostr);
 }
 
-void MCTS::DisplayPolicy(int depth, ostream& ostr) const
+template <class DOMAIN>
+void MCTS_SEARCH<DOMAIN>::DisplayPolicy(int depth, ostream& ostr) const
 {
     HISTORY history;
     ostr << "MCTS Policy:" << endl;
     Root->DisplayPolicy(history, depth, ostr);
 }
+
+template class MCTS_SEARCH<SIMULATOR>;
+template class MCTS_SEARCH<ROCKSAMPLE>;
+template class MCTS_SEARCH<CELLAR>;
+template class MCTS_SEARCH<DRONE>;
+template class MCTS_SEARCH<MOBIPICK>;
@@ -4,6 +4,8 @@
 #include "simulator.h"
 #include "node.h"
 #include "statistic.h"
+#include "threadpool.h"
+#include "particlearena.h"
 #include <stack>
 
 class MCTS
@@ -29,20 +31,68 @@ public:
         int ExpandCount;
         double ExplorationConstant;
         bool DisableTree;
+        int NumThreads; // Threads for transform generation
+        bool PinThreads; // Pin worker threads to CPUs spread over NUMA nodes
+        bool ConstructiveTransforms; // Condition transforms on the last observation
+        int MaxNodeParticles; // Reservoir size for tree node beliefs (0 = unlimited)
+        bool LazyBeliefs; // Sample the initial belief on demand, ignores NumStartStates
+        bool ShareParticles; // Keep tree node particles in one arena, equal states stored once
+        int MaxNodes; // Node budget for the search tree (0 = unlimited)
+        bool PruneTree; // Free least visited subtrees at the budget, instead of only not expanding
+        bool TrimMemory; // Return unused pool chunks after each step
+        int Interleave; // Simulations descending the tree together (1 = one at a time)
+        int AsyncSimulations; // Simulations in flight with asynchronous steps (0 = off)
 		STATE* startstate = 0; //Added for consistency with randomly generated initial states
 		bool useFtable = false;
     };
 
-    MCTS(const SIMULATOR& simulator, const PARAMS& params);
-    ~MCTS();
+    // Search specialised for DOMAIN, so that simulator calls of the final
+    // domain classes are bound statically. DOMAIN = SIMULATOR searches any
+    // domain through virtual calls. simulator must be a DOMAIN.
+    template <class DOMAIN>
+    static MCTS* Create(const SIMULATOR& simulator, const PARAMS& params);
+    typedef MCTS* (*FACTORY)(const SIMULATOR& simulator, const PARAMS& params);
+
+    virtual ~MCTS() { }
+
+    virtual int SelectAction() = 0;
+    virtual bool Update(int action, int observation, double reward) = 0;
+
+    virtual const HISTORY& GetHistory() const = 0;
+    virtual const SIMULATOR::STATUS& GetStatus() const = 0;
+
+    static void UnitTest();
+    static void InitFastUCB(double exploration);
+
+protected:
+
+    // Fast lookup table for UCB
+    static const int UCB_N = 10000, UCB_n = 100;
+    static double UCB[UCB_N][UCB_n];
+    static bool InitialisedFastUCB;
+};
+
+template <class DOMAIN>
+class MCTS_SEARCH : public MCTS
+{
+public:
+
+    MCTS_SEARCH(const DOMAIN& simulator, const PARAMS& params);
+    ~MCTS_SEARCH();
 
     int SelectAction();
     bool Update(int action, int observation, double reward);
 
-    void UCTSearch();
-    void RolloutSearch();
+    // The search loops are specialised for the rollout knowledge LEVEL,
+    // IRE (FTABLE) and VERBOSE (Params.Verbose >= 2), so that the loops
+    // carry no configuration tests. SelectAction picks the instance.
+    template <int LEVEL, bool FTABLE, bool VERBOSE> void Search();
+    template <int LEVEL, bool FTABLE, bool VERBOSE> void UCTSearch();
+    template <int LEVEL, bool FTABLE, bool VERBOSE> void UCTSearchInterleaved();
+    template <int LEVEL, bool FTABLE, bool VERBOSE> void UCTSearchAsync();
+    template <int LEVEL, bool FTABLE, bool VERBOSE> void RolloutSearch();
 
-    REWARD Rollout(STATE &state);
+    template <int LEVEL, bool VERBOSE> REWARD Rollout(STATE &state);
 
     const BELIEF_STATE& BeliefState() const { return Root->Beliefs(); }
     const HISTORY& GetHistory() const { return History; }
@@ -51,19 +101,54 @@ public:
     void DisplayStatistics(std::ostream& ostr) const;
     void DisplayValue(int depth, std::ostream& ostr) const;
     void DisplayPolicy(int depth, std::ostream& ostr) const;
-
-    static void UnitTest();
-    static void InitFastUCB(double exploration);
 	 
 	void getFValues(std::vector<double> fvalues);
 
 private:
-    const SIMULATOR& Simulator;
+    const DOMAIN& Simulator;
     int TreeDepth, PeakTreeDepth;
     PARAMS Params;
     VNODE* Root;
     HISTORY History;
     SIMULATOR::STATUS Status;
+    THREAD_POOL* Workers;
+    bool RolloutHistory; // Record rollout steps, only if the simulator reads them
+    PARTICLE_ARENA Arena; // Particles of the tree below the root
+    int NumPrunes, NumPrunedNodes, NumSkippedExpansions;
+
+    // Tree path of the current simulation, backed up after the leaf
+    struct PATH_STEP
+    {
+        VNODE* Node;
+        int Action, Observation;
+        double ImmediateReward;
+        bool Terminal;
+    };
+    std::vector<PATH_STEP> Path;
+
+    // Search state of a simulation in flight in the interleaved and
+    // asynchronous searches
+    struct SIMULATION
+    {
+        SIMULATION()
+        :   State(0), Node(0), TreeDepth(0), PeakTreeDepth(0),
+            Pending(false), InRollout(false)
+        { }
+
+        STATE* State;
+        VNODE* Node;
+        HISTORY History;
+        std::vector<PATH_STEP> Path;
+        SIMULATOR::STATUS Status;
+        int TreeDepth, PeakTreeDepth;
+
+        // Asynchronous search only: the step in flight and the rollout so far
+        SIMULATOR::ASYNC_STEP Step;
+        bool Pending, InRollout, RolloutTerminal;
+        int RolloutSteps;
+        double RolloutReward, RolloutDiscount;
+    };
+    enum { STEP_DESCEND, STEP_LEAF, STEP_ROLLOUT };
 
     STATISTIC StatTreeDepth;
     STATISTIC StatRolloutDepth;
@@ -76,18 +161,31 @@ private:
     // Core MCTS Functions
     int GreedyUCB(VNODE* vnode, bool ucb) const;
     int SelectRandom() const;
-    REWARD SimulateV(STATE &state, VNODE *vnode);
-    REWARD SimulateQ(STATE &state, QNODE &qnode, int action);
+    template <int LEVEL> void SearchLevel();
+    template <int LEVEL, bool FTABLE, bool VERBOSE>
+    REWARD Simulate(STATE &state, VNODE *vnode);
+    template <int LEVEL, bool FTABLE, bool VERBOSE>
+    bool Descend(STATE &state, VNODE *&vnode, REWARD &reward);
+    bool SelectStep(STATE &state, VNODE *vnode, int &action);
+    template <bool VERBOSE>
+    int CompleteStep(STATE &state, VNODE *&vnode, int action,
+        int observation, double immediateReward, bool terminal);
+    template <bool VERBOSE> void StartSimulation(SIMULATION& simulation);
+    template <int LEVEL, bool FTABLE, bool VERBOSE>
+    bool AdvanceAsync(SIMULATION& simulation);
+    template <bool FTABLE, bool VERBOSE> bool FinishAsync(REWARD reward);
+    template <bool FTABLE> void Backup(REWARD &reward);
+    void SwapSimulation(SIMULATION& simulation);
     VNODE* ExpandNode(const STATE* state);
     void AddSample(VNODE* node, const STATE& state);
     void AddTransforms(VNODE* root, BELIEF_STATE& beliefs);
-    STATE* CreateTransform() const;
+    void AddTransformsParallel(BELIEF_STATE& beliefs, int& attempts, int& added);
+    void CreateTransforms(int count, std::vector<STATE*>& transforms) const;
     void Resample(BELIEF_STATE& beliefs);
+    bool TreeFull() const { return Params.MaxNodes > 0 && VNODE::GetNumAllocated() >= Params.MaxNodes; }
+    void Prune();
 
-    // Fast lookup table for UCB
-    static const int UCB_N = 10000, UCB_n = 100;
-    static double UCB[UCB_N][UCB_n];
-    static bool InitialisedFastUCB;
+    static const int TransformBatch = 64; // Particles stepped together
 
     double FastUCB(int N, int n, double logN) const;
 
@@ -97,4 +195,10 @@ private:
     static void UnitTestSearch(int depth);
 };
 
+template <class DOMAIN>
+MCTS* MCTS::Create(const SIMULATOR& simulator, const PARAMS& params)
+{
+    return new MCTS_SEARCH<DOMAIN>(safe_cast<const DOMAIN&>(simulator), params);
+}
+
 #endif // MCTS_H
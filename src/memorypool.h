@@ -3,27 +3,134 @@
 
 #include <vector>
 #include <ostream>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+#include <sys/mman.h>
 
+// Free objects are chained through Next, an allocated object points to
+// itself. Copying an object never copies its link.
 class MEMORY_OBJECT
 {
 public:
 
-    void SetAllocated() { Allocated = true; }
-    void ClearAllocated() { Allocated = false; }
-    bool IsAllocated() const { return Allocated; }
+    MEMORY_OBJECT() : Next(this) { }
+    MEMORY_OBJECT(const MEMORY_OBJECT&) : Next(this) { }
+    MEMORY_OBJECT& operator=(const MEMORY_OBJECT&) { return *this; }
+
+    void SetAllocated() { Next = this; }
+    void ClearAllocated() { Next = 0; }
+    bool IsAllocated() const { return Next == this; }
+
+private:
+
+    MEMORY_OBJECT* Next;
+
+template <class T> friend class MEMORY_POOL;
+};
+
+// Defaults for pools that are not configured themselves, set once before
+// the search starts
+class MEMORY_POOL_SETTINGS
+{
+public:
+
+    static int& ChunkSize()
+    {
+        static int chunkSize = 256;
+        return chunkSize;
+    }
+
+    // Back chunks with 2 MB pages, chunks are rounded up to whole pages
+    static bool& HugePages()
+    {
+        static bool hugePages = false;
+        return hugePages;
+    }
+};
+
+// Index of the calling thread into the per-thread pool caches: 0 for
+// the main thread, worker threads hold a free slot while they run
+class THREAD_SLOT
+{
+public:
+
+    static const int MaxSlots = 64;
+
+    static int Current() { return Slot(); }
+
+    static void Acquire()
+    {
+        for (int i = 1; i < MaxSlots; ++i)
+        {
+            bool used = false;
+            if (Used()[i].compare_exchange_strong(used, true))
+            {
+                Slot() = i;
+                int slots = NumSlots().load();
+                while (slots <= i && !NumSlots().compare_exchange_weak(slots, i + 1))
+                    ;
+                return;
+            }
+        }
+        throw std::runtime_error("Too many threads for the memory pools");
+    }
+
+    static void Release()
+    {
+        Used()[Slot()].store(false);
+        Slot() = 0;
+    }
+
+    // Slots that were ever used
+    static int GetNumSlots() { return NumSlots().load(std::memory_order_relaxed); }
 
 private:
 
-    bool Allocated;
+    static int& Slot()
+    {
+        static thread_local int slot = 0;
+        return slot;
+    }
+
+    static std::atomic<bool>* Used()
+    {
+        static std::atomic<bool> used[MaxSlots] = {};
+        return used;
+    }
+
+    static std::atomic<int>& NumSlots()
+    {
+        static std::atomic<int> numSlots(1);
+        return numSlots;
+    }
 };
 
+/*
+    Each thread allocates from and frees into its own cache without
+    locking. Caches take objects from the shared free list in batches,
+    under the mutex, and hand surplus batches back through a lock-free
+    stack, so objects freed by another thread than the one that allocated
+    them flow back to the shared list. Trim and DeleteAll must not run
+    concurrently with other threads using the pool.
+*/
 template <class T>
 class MEMORY_POOL
 {
 public:
 
     MEMORY_POOL()
-    : NumAllocated(0)
+    :   FreeHead(0),
+        NumFree(0),
+        Returned(0),
+        PeakAllocated(0),
+        NumObjects(0),
+        ChunkSize(0),
+        HugePages(false),
+        Configured(false)
     {
     }
 
@@ -32,6 +139,15 @@ public:
         DeleteAll();
     }
 
+    // Chunk size in objects for chunks allocated from now on
+    void Configure(int chunkSize, bool hugePages)
+    {
+        assert(chunkSize > 0);
+        ChunkSize = chunkSize;
+        HugePages = hugePages;
+        Configured = true;
+    }
+
     T* Construct()
     {
         T* obj = Allocate();
@@ -46,58 +162,253 @@ public:
 
     T* Allocate() 
     { 
-        if (FreeList.empty())
-            NewChunk();
-        T* obj = FreeList.back();
-        FreeList.pop_back();
+        CACHE& cache = Caches[THREAD_SLOT::Current()];
+        if (!cache.Head)
+            Refill(cache);
+        T* obj = static_cast<T*>(cache.Head);
+        cache.Head = obj->Next;
+        cache.Count--;
         assert(!obj->IsAllocated());
         obj->SetAllocated();
-        NumAllocated++;
+        cache.Allocated.store(cache.Allocated.load(std::memory_order_relaxed) + 1,
+            std::memory_order_relaxed);
         return obj;
     }
     
     void Free(T* obj) 
     { 
         assert(obj->IsAllocated());
-        obj->ClearAllocated();
-        FreeList.push_back(obj);
-        NumAllocated--;
+        CACHE& cache = Caches[THREAD_SLOT::Current()];
+        obj->Next = cache.Head;
+        cache.Head = obj;
+        cache.Count++;
+        cache.Allocated.store(cache.Allocated.load(std::memory_order_relaxed) - 1,
+            std::memory_order_relaxed);
+        if (cache.Count > 4 * Batch)
+            Return(cache);
     }
     
     void DeleteAll()
     {
         for (ChunkIterator i_chunk = Chunks.begin(); i_chunk != Chunks.end(); ++i_chunk)
-            delete *i_chunk;
+            DeleteChunk(*i_chunk);
         Chunks.clear();
-        FreeList.clear();
-        NumAllocated = 0;
+        for (int i = 0; i < THREAD_SLOT::MaxSlots; ++i)
+        {
+            Caches[i].Head = 0;
+            Caches[i].Count = 0;
+            Caches[i].Allocated.store(0, std::memory_order_relaxed);
+        }
+        FreeHead = 0;
+        NumFree = 0;
+        Returned.store(0);
+        NumObjects = 0;
+    }
+
+    // Return chunks without allocated objects, e.g. between steps
+    void Trim()
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        for (int i = 0; i < THREAD_SLOT::MaxSlots; ++i)
+        {
+            Caches[i].Head = 0;
+            Caches[i].Count = 0;
+        }
+        Returned.store(0);
+
+        std::vector<CHUNK> chunks;
+        for (ChunkIterator i_chunk = Chunks.begin(); i_chunk != Chunks.end(); ++i_chunk)
+        {
+            bool empty = true;
+            for (int i = 0; i < i_chunk->Size && empty; ++i)
+                empty = !i_chunk->Objects[i].IsAllocated();
+            if (empty)
+            {
+                NumObjects -= i_chunk->Size;
+                DeleteChunk(*i_chunk);
+            }
+            else
+                chunks.push_back(*i_chunk);
+        }
+        Chunks.swap(chunks);
+
+        // Chain all free objects into the shared list again, cached ones included
+        FreeHead = 0;
+        NumFree = 0;
+        for (int c = Chunks.size() - 1; c >= 0; --c)
+            for (int i = Chunks[c].Size - 1; i >= 0; --i)
+                if (!Chunks[c].Objects[i].IsAllocated())
+                {
+                    Chunks[c].Objects[i].Next = FreeHead;
+                    FreeHead = &Chunks[c].Objects[i];
+                    NumFree++;
+                }
     }
     
-    int GetNumAllocated() const { return NumAllocated; }
+    int GetNumAllocated() const
+    {
+        int allocated = 0;
+        for (int i = 0; i < THREAD_SLOT::GetNumSlots(); ++i)
+            allocated += Caches[i].Allocated.load(std::memory_order_relaxed);
+        return allocated;
+    }
+    int GetPeakAllocated() const { return PeakAllocated; }
+    int GetNumObjects() const { return NumObjects; }
+    int GetNumChunks() const { return Chunks.size(); }
+
+    void DisplayStatistics(const char* name, std::ostream& ostr) const
+    {
+        ostr << name << " pool: " << GetNumAllocated() << " in use, "
+            << PeakAllocated << " peak, " << NumObjects << " objects in "
+            << Chunks.size() << " chunks" << std::endl;
+    }
 
 private:
 
+    // Objects moved between a thread cache and the shared list at once
+    static const int Batch = 64;
+
+    struct alignas(64) CACHE
+    {
+        CACHE() : Head(0), Count(0), Allocated(0) { }
+
+        MEMORY_OBJECT* Head;
+        int Count;
+        // Allocations minus frees by this thread, which alone writes it;
+        // atomic as other threads sum it in GetNumAllocated
+        std::atomic<int> Allocated;
+    };
+
+    void Refill(CACHE& cache)
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+
+        // Take over the batches other threads handed back
+        MEMORY_OBJECT* returned = Returned.exchange(0, std::memory_order_acquire);
+        while (returned)
+        {
+            MEMORY_OBJECT* next = returned->Next;
+            returned->Next = FreeHead;
+            FreeHead = returned;
+            NumFree++;
+            returned = next;
+        }
+
+        if (!FreeHead)
+            NewChunk();
+        for (int i = 0; i < Batch && FreeHead; ++i)
+        {
+            MEMORY_OBJECT* obj = FreeHead;
+            FreeHead = obj->Next;
+            NumFree--;
+            obj->Next = cache.Head;
+            cache.Head = obj;
+            cache.Count++;
+        }
+
+        // Sampled here only, so the peak is accurate to a batch per thread
+        int allocated = GetNumAllocated();
+        if (allocated > PeakAllocated)
+            PeakAllocated = allocated;
+    }
+
+    // Hand a batch back to the shared list without taking the mutex
+    void Return(CACHE& cache)
+    {
+        MEMORY_OBJECT* first = cache.Head;
+        MEMORY_OBJECT* last = first;
+        for (int i = 1; i < Batch; ++i)
+            last = last->Next;
+        cache.Head = last->Next;
+        cache.Count -= Batch;
+
+        MEMORY_OBJECT* head = Returned.load(std::memory_order_relaxed);
+        do
+            last->Next = head;
+        while (!Returned.compare_exchange_weak(head, first,
+            std::memory_order_release, std::memory_order_relaxed));
+    }
+
     struct CHUNK
     {
-        static const int Size = 256;
-        T Objects[Size];
+        T* Objects;
+        int Size;
+        std::size_t Bytes;
+        bool Mapped;
     };
 
+    // Objects are constructed by the thread that needs them, so that with
+    // pinned threads the chunk is placed on that thread's NUMA node
     void NewChunk()
     {
-        CHUNK* chunk = new CHUNK;
-        Chunks.push_back(chunk);
-        for (int i = CHUNK::Size - 1; i >= 0; --i)
+        if (!Configured)
+            Configure(MEMORY_POOL_SETTINGS::ChunkSize(), MEMORY_POOL_SETTINGS::HugePages());
+
+        CHUNK chunk;
+        chunk.Size = ChunkSize;
+        chunk.Bytes = ChunkSize * sizeof(T);
+        chunk.Mapped = false;
+        void* memory = 0;
+        if (HugePages)
         {
-            FreeList.push_back(&chunk->Objects[i]);
-            chunk->Objects[i].ClearAllocated();
+            // Fill whole huge pages, fall back to transparent huge pages
+            const std::size_t hugePage = 2 << 20;
+            chunk.Bytes = (chunk.Bytes + hugePage - 1) / hugePage * hugePage;
+            chunk.Size = chunk.Bytes / sizeof(T);
+#ifdef MAP_HUGETLB
+            memory = mmap(0, chunk.Bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#else
+            memory = MAP_FAILED;
+#endif
+            if (memory == MAP_FAILED)
+            {
+                memory = mmap(0, chunk.Bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (memory == MAP_FAILED)
+                    throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+                madvise(memory, chunk.Bytes, MADV_HUGEPAGE);
+#endif
+            }
+            chunk.Mapped = true;
         }
+        else
+            memory = ::operator new(chunk.Bytes);
+
+        chunk.Objects = static_cast<T*>(memory);
+        for (int i = 0; i < chunk.Size; ++i)
+            new (&chunk.Objects[i]) T;
+        for (int i = chunk.Size - 1; i >= 0; --i)
+        {
+            chunk.Objects[i].Next = FreeHead;
+            FreeHead = &chunk.Objects[i];
+        }
+        Chunks.push_back(chunk);
+        NumObjects += chunk.Size;
+        NumFree += chunk.Size;
+    }
+
+    void DeleteChunk(CHUNK& chunk)
+    {
+        for (int i = 0; i < chunk.Size; ++i)
+            chunk.Objects[i].~T();
+        if (chunk.Mapped)
+            munmap(chunk.Objects, chunk.Bytes);
+        else
+            ::operator delete(chunk.Objects);
     }
 
-    std::vector<CHUNK*> Chunks;
-    std::vector<T*> FreeList;
-    int NumAllocated;
-    typedef typename std::vector<CHUNK*>::iterator ChunkIterator;
+    CACHE Caches[THREAD_SLOT::MaxSlots];
+    std::vector<CHUNK> Chunks;
+    MEMORY_OBJECT* FreeHead;
+    int NumFree;
+    std::atomic<MEMORY_OBJECT*> Returned;
+    int PeakAllocated, NumObjects;
+    int ChunkSize;
+    bool HugePages, Configured;
+    std::mutex Mutex;
+    typedef typename std::vector<CHUNK>::iterator ChunkIterator;
 };
 
 #endif // MEMORY_POOL_H
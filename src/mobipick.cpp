@@ -8,27 +8,9 @@ using namespace std;
 using namespace UTILS;
 
 void MOBIPICK_STATE::activateFeature(int feature, bool status){
-    // Find object id within Tables
-    bool done = false;
-    if(feature >= 0){
-        for(auto& t : Tables){
-            for(auto& o : t.Objects){
-                if(o.id == feature){
-                    o.active = status;
-                    done = true;
-                }
-                if(done) break;
-            }
-            if(done) break;
-        }
-    }
-}
-
-MOBIPICK_STATE::~MOBIPICK_STATE(){
-    for(auto& t : Tables){
-        t.Objects.clear();
-    }
-    Tables.clear();
+    // Only objects on tables are (de)activated
+    if(feature >= 0 && Objects[feature].Location >= 0)
+        Objects[feature].active = status;
 }
 
 /* Build Ftable mapping every action to its affected feature/object */
@@ -89,6 +71,10 @@ MOBIPICK::MOBIPICK(PROBLEM_PARAMS& problem_params){
     PGSAlpha = params.PGSAlpha;
     
     IDENTIFY_THRESHOLD = BIN_ENTROPY_LIMIT; //TODO: Set separate parameter
+    
+    //Entropy limits as probability intervals
+    EntropyBound = BinaryEntropyBound(BIN_ENTROPY_LIMIT);
+    IdentifyBound = BinaryEntropyBound(IDENTIFY_THRESHOLD);
 
     //SIMULATOR CLASS PARAMETERS
     NumActions = NumPoses + 2*NumObjects + 1 + 1; //Navigate to every pose, pick+id every object, place at location, perceive at location
@@ -107,6 +93,8 @@ MOBIPICK::MOBIPICK(PROBLEM_PARAMS& problem_params){
     P_TABLE = 3;
     P_NEAR = P_TABLE + NumTables;
     
+    assert(NumObjects <= MOBIPICK_STATE::MaxObjects && NumTables <= MOBIPICK_STATE::MaxTables);
+    
     if (NumCylinders == 3 && NumObjects == 6 && NumTables == 2)
         Init_Demo1();
     else
@@ -170,7 +158,13 @@ STATE* MOBIPICK::Copy(const STATE& state) const
 {
     const MOBIPICK_STATE& mobipickState = safe_cast<const MOBIPICK_STATE&>(state);
     MOBIPICK_STATE* newstate = MemoryPool.Allocate();
-    *newstate = mobipickState;
+    newstate->AgentPose = mobipickState.AgentPose;
+    newstate->inGrasp = mobipickState.inGrasp;
+    newstate->grasping = mobipickState.grasping;
+    newstate->BasketCount = mobipickState.BasketCount;
+    memcpy(newstate->Objects, mobipickState.Objects, NumObjects * sizeof(MOBIPICK_STATE::OBJECT));
+    memcpy(newstate->Order, mobipickState.Order, NumObjects * sizeof(int));
+    memcpy(newstate->TableStart, mobipickState.TableStart, (NumTables + 1) * sizeof(int));
     return newstate;
 }
 
@@ -186,24 +180,21 @@ STATE* MOBIPICK::CreateStartState() const
     MOBIPICK_STATE* mobipickState = MemoryPool.Allocate();
     mobipickState->AgentPose = P_OTHER;
     
-    //Clear Tables array
-    mobipickState->Tables.clear();
-
     //Add tables and objects
     int id = 0;
     int o_id = 0;
     for (auto table : initTables){
-        MOBIPICK_STATE::TABLE t;
-        
-        t.id = id++;
+        mobipickState->TableStart[id++] = o_id;
 
         //Add objects
         for(auto o_type : table){
-            MOBIPICK_STATE::OBJECT o;
+            MOBIPICK_STATE::OBJECT& o = mobipickState->Objects[o_id];
             
             //Ground truth:
-            o.id = o_id++;
+            o.id = o_id;
             o.type = o_type; //F_CYL, F_NOCYL
+            o.Location = id - 1;
+            o.Slot = o_id;
         
             //Probabilistic properties:
             o.measured = 0;
@@ -220,20 +211,19 @@ STATE* MOBIPICK::CreateStartState() const
             
             o.active = true;
             
-            //Add to object array
-            t.Objects.push_back(o);
+            //Add to table
+            mobipickState->Order[o_id++] = o.id;
         }
-        
-        //Add table to array
-        mobipickState->Tables.push_back(t);
     }
+    mobipickState->TableStart[id] = o_id;
+    assert(o_id == NumObjects);
 
     //Set object in grasp
-    //mobipickState->inGrasp = NULL;
+    mobipickState->inGrasp = -1;
     mobipickState->grasping = false;
     
-    //Set basket
-    mobipickState->Basket.pose = P_BASKET;
+    //Empty basket
+    mobipickState->BasketCount = 0;
 
     return mobipickState;
 }
@@ -391,7 +381,7 @@ bool MOBIPICK::StepNormal(STATE& state, int action,
                 reward = terminal_success;
                 return true;
             }*/                    
-            if(mobipickState.Basket.Objects.size() > 0)
+            if(mobipickState.BasketCount > 0)
                 reward = terminal_success;
             else
                 reward =  terminal_fail;
@@ -414,52 +404,31 @@ bool MOBIPICK::StepNormal(STATE& state, int action,
         
         //If not holding, locate object id
         int obj = action - A_PICK; //Get object id
-        int obj_pos = 0;
-        bool found = false;
-        
-        //Find table with object
-        int table_id = 0;
-        for(auto& t : mobipickState.Tables){
-            obj_pos = 0;
-            for(auto& o : t.Objects){
-                if(o.id == obj){
-                    table_id = t.id;
-                    found = true;                 
-                }
-                if(found) break;
-                obj_pos++;
-            }
-            if(found) break;
-        }
-        
-        //cout << "Object " << obj << " found on table " << table_id << " at pos = " << obj_pos << endl;
-        
-        //Attempt if pose == at table              
         assert(obj < NumObjects);
+        MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[obj];
         
-        //Verify pose allows grasping object id
-        if(mobipickState.AgentPose == P_TABLE + table_id && found){                        
+        //Verify pose allows grasping object id (on this table)
+        if(o.Location >= 0 && mobipickState.AgentPose == P_TABLE + o.Location){
             //cout << "Attempting to grab obj " << obj << endl;
                         
             //If Position is not known, fail grasp
-            if(!mobipickState.Tables[table_id].Objects[obj_pos].PosKnown){
+            if(!o.PosKnown){
                 return false;
             }
             
             double p_grasp = MOBIPICK::PROB_GRASP_OTHER; //Assume not a cyl
             //If object IS a cylinder, adjust simulated grasping probability
-            if(mobipickState.Tables[table_id].Objects[obj_pos].type == F_CYL) p_grasp = MOBIPICK::PROB_GRASP;
+            if(o.type == F_CYL) p_grasp = MOBIPICK::PROB_GRASP;
             
             if(Bernoulli(p_grasp)){
                 observation = O_SUCCESS;
                 
-                //TODO: create POP function that returns a pointer or Object
-                mobipickState.inGrasp.copy(mobipickState.Tables[table_id].Objects[obj_pos]); //Create copy of obj in grasp
+                RemoveFromTable(mobipickState, obj); //Remove from table
+                o.Location = MOBIPICK_STATE::L_GRASP;
+                mobipickState.inGrasp = obj;
                 mobipickState.grasping = true;
                 
-                mobipickState.Tables[table_id].Objects.erase(mobipickState.Tables[table_id].Objects.begin() + obj_pos); //Remove from table
-                
-                //cout << "Now grasping obj " << mobipickState.inGrasp->id << endl;
+                //cout << "Now grasping obj " << mobipickState.inGrasp << endl;
             }
             else{
                 //If grasping fails, receive small punishment (i.e. more likely for non-cyls)
@@ -477,28 +446,12 @@ bool MOBIPICK::StepNormal(STATE& state, int action,
         int obj  = action - A_IDENTIFY;        
         reward = reward_identify;
         
-        //Find table with object
-        int table_id = 0;
-        bool found = false;
-        int obj_pos = 0;
-        
-        for(auto t : mobipickState.Tables){
-            table_id = t.id;
-            obj_pos = 0;
-            for(auto o : t.Objects){
-                if(o.id == obj){                    
-                    found = true;
-                }
-                if(found) break;
-                obj_pos++;
-            }
-            if(found) break;
-        }
-        
         //Assume failure
         observation = O_FAIL;
         
-        if(!found) return false; //e.g. object is in grasp, or in basket
+        MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[obj];
+        int table_id = o.Location;
+        if(table_id < 0) return false; //e.g. object is in grasp, or in basket
         
         //Object is on table_id, verify correct pose        
         if(mobipickState.AgentPose != P_TABLE + table_id && mobipickState.AgentPose != P_NEAR + table_id){
@@ -506,30 +459,29 @@ bool MOBIPICK::StepNormal(STATE& state, int action,
         }
                 
         //Receive observation from sensor
-        //cout << "Identifying pos = " << obj_pos << ", obj " << mobipickState.Tables[table_id].Objects[obj_pos].id << endl;
-        observation = Identify(mobipickState.Tables[table_id].Objects[obj_pos]);
+        observation = Identify(o);
         
         if(observation == O_FAIL) return false;
         
         ///If we made it this far, everything is in order
-        mobipickState.Tables[table_id].Objects[obj_pos].measured++;
+        o.measured++;
         //DisplayObservation(mobipickState, observation, cout);
 
         //Compute Likelihoods from observation
         double efficiency = MOBIPICK::IDENTIFY_ACC;
         if (observation == O_CYL) {
-            mobipickState.Tables[table_id].Objects[obj_pos].count++;
-            mobipickState.Tables[table_id].Objects[obj_pos].LikelihoodCyl *= efficiency;
-            mobipickState.Tables[table_id].Objects[obj_pos].LikelihoodNotCyl *= 1.0 - efficiency;
+            o.count++;
+            o.LikelihoodCyl *= efficiency;
+            o.LikelihoodNotCyl *= 1.0 - efficiency;
         } else {
-            mobipickState.Tables[table_id].Objects[obj_pos].count--;
-            mobipickState.Tables[table_id].Objects[obj_pos].LikelihoodNotCyl *= efficiency;
-            mobipickState.Tables[table_id].Objects[obj_pos].LikelihoodCyl *= 1.0 - efficiency;
+            o.count--;
+            o.LikelihoodNotCyl *= efficiency;
+            o.LikelihoodCyl *= 1.0 - efficiency;
         }
 
         //Update target probability
-        double denom = (0.5 * mobipickState.Tables[table_id].Objects[obj_pos].LikelihoodCyl) + (0.5 * mobipickState.Tables[table_id].Objects[obj_pos].LikelihoodNotCyl);
-        mobipickState.Tables[table_id].Objects[obj_pos].ProbCyl = (0.5 * mobipickState.Tables[table_id].Objects[obj_pos].LikelihoodCyl) / denom;
+        double denom = (0.5 * o.LikelihoodCyl) + (0.5 * o.LikelihoodNotCyl);
+        o.ProbCyl = (0.5 * o.LikelihoodCyl) / denom;
         
         return false;
     }
@@ -553,12 +505,12 @@ bool MOBIPICK::StepNormal(STATE& state, int action,
         //If at basket, verify terminal state
         if(mobipickState.AgentPose == P_BASKET){
             //Reward accordingly
-            if(mobipickState.inGrasp.type == F_CYL) reward = reward_good; //TODO: switch to assumed type
+            if(mobipickState.Objects[mobipickState.inGrasp].type == F_CYL) reward = reward_good; //TODO: switch to assumed type
             else reward = reward_bad;
             
             //Transfer object to basket
-            MOBIPICK_STATE::OBJECT o(mobipickState.inGrasp);
-            mobipickState.Basket.Objects.push_back(o);            
+            mobipickState.Objects[mobipickState.inGrasp].Location = MOBIPICK_STATE::L_BASKET;
+            mobipickState.BasketCount++;
             mobipickState.grasping = false;
             
             observation = O_SUCCESS;
@@ -571,8 +523,7 @@ bool MOBIPICK::StepNormal(STATE& state, int action,
             table_id = mobipickState.AgentPose - P_TABLE;
             
             //Transfer object to table
-            MOBIPICK_STATE::OBJECT o(mobipickState.inGrasp);
-            mobipickState.Tables[table_id].Objects.push_back(o);            
+            PlaceOnTable(mobipickState, mobipickState.inGrasp, table_id);
             mobipickState.grasping = false;
             
             observation = O_SUCCESS;
@@ -599,7 +550,8 @@ bool MOBIPICK::StepNormal(STATE& state, int action,
         
         //Update knowledge about the position of each object on table        
         
-        for(auto& o : mobipickState.Tables[table_id].Objects){
+        for(int i = 0; i < mobipickState.TableSize(table_id); i++){
+            MOBIPICK_STATE::OBJECT& o = mobipickState.TableObject(table_id, i);
             o.LikelihoodPos *= efficiency;
             o.LikelihoodNotPos *= 1.0 - efficiency;
 
@@ -608,8 +560,7 @@ bool MOBIPICK::StepNormal(STATE& state, int action,
             o.ProbPos = (0.5 * o.LikelihoodPos) / denom;
             
             //Update known position
-            double binEntropy = -1*o.ProbPos*log2(o.ProbPos) - (1-o.ProbPos)*log2(1-o.ProbPos);
-            if(binEntropy <= MOBIPICK::IDENTIFY_THRESHOLD){
+            if(LowEntropy(o.ProbPos, IdentifyBound)){
                 o.PosKnown = true;
             }
         }
@@ -629,13 +580,13 @@ bool MOBIPICK::LocalMove(STATE& state, const HISTORY& history, int stepObs, cons
     int table = Random(NumTables);
     
     //If this table is now empty, local move is not valid
-    if(mobipickState.Tables[table].Objects.size() == 0){
+    if(mobipickState.TableSize(table) == 0){
         return false;        
     }
     
-    int obj = Random(mobipickState.Tables[table].Objects.size());
+    int obj = Random(mobipickState.TableSize(table));
     
-    mobipickState.Tables[table].Objects[obj].type = !mobipickState.Tables[table].Objects[obj].type;
+    mobipickState.TableObject(table, obj).type = !mobipickState.TableObject(table, obj).type;
     
     int action = history.Back().Action;
 
@@ -646,21 +597,10 @@ bool MOBIPICK::LocalMove(STATE& state, const HISTORY& history, int stepObs, cons
         obj = action - A_IDENTIFY;
         int realObs = history.Back().Observation;
         
-        bool found = false;
-        int obj_pos = 0;
-        for(auto t : mobipickState.Tables){
-            table = t.id;
-            obj_pos = 0;
-            for(auto o : t.Objects){
-                if(o.id == obj) found = true;
-                if(found) break;
-                obj_pos++;
-            }
-            if(found) break;
-        }
-        
-        //Get new observation
-        int newObs = Identify(mobipickState.Tables[table].Objects[obj_pos]);
+        //Get new observation, identify fails for objects off the tables
+        int newObs = O_FAIL;
+        if(mobipickState.Objects[obj].Location >= 0)
+            newObs = Identify(mobipickState.Objects[obj]);
 
         //If observations do not match, reject
         if (newObs != realObs)
@@ -670,6 +610,70 @@ bool MOBIPICK::LocalMove(STATE& state, const HISTORY& history, int stepObs, cons
     return true;
 }
 
+//Constructive version of LocalMove
+//Samples the (table, object) flip with the same proposal weights, times the
+//likelihood of the last identify observation under the resulting types
+bool MOBIPICK::ConditionedMove(STATE& state, const HISTORY& history, int stepObs, const STATUS& status) const{
+    
+    MOBIPICK_STATE& mobipickState = safe_cast<MOBIPICK_STATE&>(state);
+    int action = history.Back().Action;
+    int realObs = history.Back().Observation;
+    
+    //Identified object, and likelihood of the real observation for each of its types
+    const MOBIPICK_STATE::OBJECT* identified = 0;
+    double likelihood[2] = {1.0, 1.0};
+    if (action >= A_IDENTIFY && action < A_PLACE) {
+        int obj = action - A_IDENTIFY;
+        if(mobipickState.Objects[obj].Location >= 0)
+            identified = &mobipickState.Objects[obj];
+        
+        if(identified){
+            for(int type = 0; type < 2; type++){
+                int obs;
+                if(!identified->PosKnown)
+                    obs = O_FAIL;
+                else
+                    obs = (type == F_CYL) ? O_CYL : O_NOCYL;
+                
+                if(obs == O_FAIL)
+                    likelihood[type] = (realObs == O_FAIL) ? 1.0 : 0.0;
+                else
+                    likelihood[type] = (obs == realObs) ? IDENTIFY_ACC : 1.0 - IDENTIFY_ACC;
+            }
+        }
+    }
+    
+    double total = 0.0;
+    for(int t = 0; t < NumTables; t++)
+        for(int i = 0; i < mobipickState.TableSize(t); i++){
+            const MOBIPICK_STATE::OBJECT& o = mobipickState.TableObject(t, i);
+            total += (&o == identified ? likelihood[!o.type] : likelihood[identified ? identified->type : 0]) / mobipickState.TableSize(t);
+        }
+    
+    //Accept at the rate of rejection sampling over the largest likelihood,
+    //so that states explaining the observation badly are not over-represented
+    if(total <= 0 || !Bernoulli(total / (NumTables * std::max(likelihood[0], likelihood[1]))))
+        return false;
+    
+    double r = RandomDouble(0, total);
+    MOBIPICK_STATE::OBJECT* flip = 0;
+    for(int t = 0; t < NumTables; t++){
+        for(int i = 0; i < mobipickState.TableSize(t); i++){
+            MOBIPICK_STATE::OBJECT& o = mobipickState.TableObject(t, i);
+            double w = (&o == identified ? likelihood[!o.type] : likelihood[identified ? identified->type : 0]) / mobipickState.TableSize(t);
+            if(w > 0){
+                flip = &o;
+                r -= w;
+                if(r <= 0) break;
+            }
+        }
+        if(flip && r <= 0) break;
+    }
+    
+    flip->type = !flip->type;
+    return true;
+}
+
 /* Fast PGS for Rollout policy
  * Simplified PGS point count by using only the specific action changes
  */
@@ -685,13 +689,14 @@ double MOBIPICK::PGS_RO(STATE& oldstate, STATE& state, int action, double oldpgs
     //1. Grasp: + if obj was in fact picked, and is cyl and has known pos
     if(action >= A_PICK && action < A_IDENTIFY && mobipickState.grasping){
         //If object grasped is likely a cyl AND has known position, give bonus
-        if( BinEntropyCheck(mobipickState.inGrasp.ProbCyl) && mobipickState.inGrasp.PosKnown ) points += PGS_pick_pos;
+        const MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[mobipickState.inGrasp];
+        if( BinEntropyCheck(o.ProbCyl) && o.PosKnown ) points += PGS_pick_pos;
     }
     
     //2. Place in Basket (if place and object held WAS good/bad...reward)
     else if(action >= A_PLACE && action < A_PERCEIVE){
         if(mobipickState.AgentPose == P_BASKET && oldmobipickState.grasping){
-            if(oldmobipickState.inGrasp.type == F_CYL) points += PGS_good_obj;
+            if(oldmobipickState.Objects[oldmobipickState.inGrasp].type == F_CYL) points += PGS_good_obj;
             else points += PGS_bad_obj;
         }
     }
@@ -700,24 +705,10 @@ double MOBIPICK::PGS_RO(STATE& oldstate, STATE& state, int action, double oldpgs
     else if (action >= A_IDENTIFY && action < A_PLACE){
         int obj = action - A_IDENTIFY;
         
-        //find object in table
-        int table_id, o_pos;        
-        bool found = false;
-        
-        for(auto t : mobipickState.Tables){
-            table_id = t.id;
-            o_pos = 0;            
-            for(auto o : t.Objects){
-                if(o.id == obj) found = true;
-                if(found) break;
-                o_pos++;
-            }
-            if(found) break;
-        }
-        
-        if(found){        
-            if(!BinEntropyCheck(mobipickState.Tables[table_id].Objects[o_pos].ProbCyl)) points += PGS_uncertain;                        
-            if(!BinEntropyCheck(oldmobipickState.Tables[table_id].Objects[o_pos].ProbCyl)) oldpoints += PGS_uncertain;            
+        //Only objects on a table can be identified
+        if(mobipickState.Objects[obj].Location >= 0){        
+            if(!BinEntropyCheck(mobipickState.Objects[obj].ProbCyl)) points += PGS_uncertain;                        
+            if(!BinEntropyCheck(oldmobipickState.Objects[obj].ProbCyl)) oldpoints += PGS_uncertain;            
         }
     }
     
@@ -729,9 +720,9 @@ double MOBIPICK::PGS_RO(STATE& oldstate, STATE& state, int action, double oldpgs
         
         //Action has an effect only in the above poses
         if(table_id >= 0 && table_id < NumTables){
-            for(int o_pos=0; o_pos < mobipickState.Tables[table_id].Objects.size(); o_pos++){
-                if(!mobipickState.Tables[table_id].Objects[o_pos].PosKnown) points += PGS_uncertain;
-                if(!oldmobipickState.Tables[table_id].Objects[o_pos].PosKnown) oldpoints += PGS_uncertain;
+            for(int o_pos=0; o_pos < mobipickState.TableSize(table_id); o_pos++){
+                if(!mobipickState.TableObject(table_id, o_pos).PosKnown) points += PGS_uncertain;
+                if(!oldmobipickState.TableObject(table_id, o_pos).PosKnown) oldpoints += PGS_uncertain;
             }
         }
     }
@@ -760,12 +751,14 @@ double MOBIPICK::PGS(STATE& state) const
     //2. If object in grasp
     if(mobipickState.grasping){
         //If object in grasp is likely a cyl, give bonus
-        if( BinEntropyCheck(mobipickState.inGrasp.ProbCyl) ) points += PGS_pick_pos;
+        if( BinEntropyCheck(mobipickState.Objects[mobipickState.inGrasp].ProbCyl) ) points += PGS_pick_pos;
     }
     
     //3. Points for objects in basket
-    double p_target, binaryEntropy;
-    for(auto o : mobipickState.Basket.Objects){
+    for(int i = 0; i < NumObjects; i++){
+        const MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[i];
+        if(o.Location != MOBIPICK_STATE::L_BASKET)
+            continue;
         if( o.type == F_CYL )
             points += PGS_good_obj;
         else
@@ -773,11 +766,10 @@ double MOBIPICK::PGS(STATE& state) const
     }
 
     //3. Negative points for unidentified features (type AND position)
-    for(auto t : mobipickState.Tables){
-        for(auto o : t.Objects){
-            if(!BinEntropyCheck(o.ProbCyl)) points += PGS_uncertain;
-            if(!o.PosKnown) points += PGS_uncertain;
-        }
+    for(int i = 0; i < mobipickState.TableStart[NumTables]; i++){
+        const MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[mobipickState.Order[i]];
+        if(!BinEntropyCheck(o.ProbCyl)) points += PGS_uncertain;
+        if(!o.PosKnown) points += PGS_uncertain;
     }
 
     return points;
@@ -872,7 +864,8 @@ void MOBIPICK::PGSLegal(const STATE& state, const HISTORY& history,
         legal.push_back(P_NEAR + table_id); //Navigate to NEAR this table
         
         //Add all pick actions at this table, for active and known objs
-        for(auto o : mobipickState.Tables[table_id].Objects){
+        for(int i = 0; i < mobipickState.TableSize(table_id); i++){
+            const MOBIPICK_STATE::OBJECT& o = mobipickState.TableObject(table_id, i);
             if(o.active && o.PosKnown) legal.push_back(A_PICK + o.id);
         }
         
@@ -891,10 +884,9 @@ void MOBIPICK::PGSLegal(const STATE& state, const HISTORY& history,
     
     //Identify active and unidentified objects
     if(identify)
-        for(auto t : mobipickState.Tables){
-            for(auto o : t.Objects){
-                if(o.active && o.PosKnown) legal.push_back(A_IDENTIFY + o.id);
-            }
+        for(int i = 0; i < mobipickState.TableStart[NumTables]; i++){
+            const MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[mobipickState.Order[i]];
+            if(o.active && o.PosKnown) legal.push_back(A_IDENTIFY + o.id);
         }
 
     //Place
@@ -950,16 +942,16 @@ void MOBIPICK::GenerateLegal(const STATE& state, const HISTORY& history,
     //Pick is available at a table
     if(mobipickState.AgentPose >= P_TABLE && mobipickState.AgentPose < P_NEAR){
         int table_id = mobipickState.AgentPose - P_TABLE;
-        for(auto o : mobipickState.Tables[table_id].Objects){
+        for(int i = 0; i < mobipickState.TableSize(table_id); i++){
+            const MOBIPICK_STATE::OBJECT& o = mobipickState.TableObject(table_id, i);
             if(o.active && o.PosKnown) legal.push_back(A_PICK + o.id);
         }
     }
     
     //Identify is always available, but use for active and unidentified objects
-    for(auto t : mobipickState.Tables){
-        for(auto o : t.Objects){
-            if(o.active && o.PosKnown) legal.push_back(A_IDENTIFY + o.id);
-        }
+    for(int i = 0; i < mobipickState.TableStart[NumTables]; i++){
+        const MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[mobipickState.Order[i]];
+        if(o.active && o.PosKnown) legal.push_back(A_IDENTIFY + o.id);
     }
 
     //Always allow place?
@@ -1006,6 +998,42 @@ int MOBIPICK::Identify(MOBIPICK_STATE::OBJECT& o) const {
 }
 
 
+/*
+ * Take an object off its table, closing the gap in Order
+ * */
+void MOBIPICK::RemoveFromTable(MOBIPICK_STATE& mobipickState, int obj) const {
+    MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[obj];
+    int end = mobipickState.TableStart[NumTables];
+    
+    for(int i = o.Slot; i < end - 1; i++){
+        mobipickState.Order[i] = mobipickState.Order[i + 1];
+        mobipickState.Objects[mobipickState.Order[i]].Slot = i;
+    }
+    for(int t = o.Location + 1; t <= NumTables; t++)
+        mobipickState.TableStart[t]--;
+    
+    o.Slot = -1;
+}
+
+/*
+ * Append an object to the end of a table
+ * */
+void MOBIPICK::PlaceOnTable(MOBIPICK_STATE& mobipickState, int obj, int table) const {
+    MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[obj];
+    int slot = mobipickState.TableStart[table + 1];
+    
+    for(int i = mobipickState.TableStart[NumTables]; i > slot; i--){
+        mobipickState.Order[i] = mobipickState.Order[i - 1];
+        mobipickState.Objects[mobipickState.Order[i]].Slot = i;
+    }
+    for(int t = table + 1; t <= NumTables; t++)
+        mobipickState.TableStart[t]++;
+    
+    mobipickState.Order[slot] = obj;
+    o.Slot = slot;
+    o.Location = table;
+}
+
 /*
  * Perceive (poses of objects on) table with p = PERCEIVE_ACC
  * 
@@ -1044,8 +1072,7 @@ int MOBIPICK::Perceive(int pose) const{
  * 
  * */
 bool MOBIPICK::BinEntropyCheck(double p) const {
-    double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);
-    return (binaryEntropy <= MOBIPICK::BIN_ENTROPY_LIMIT);
+    return LowEntropy(p, EntropyBound);
 }
 
 /*
@@ -1099,13 +1126,14 @@ void MOBIPICK::DisplayState(const STATE& state, std::ostream& ostr) const
     ostr << "Grasping: ";
     
     if(mobipickState.grasping){
-        ostr << " Obj. " << mobipickState.inGrasp.id << ", Type = ";
-        if(mobipickState.inGrasp.type == F_CYL)
+        const MOBIPICK_STATE::OBJECT& o = mobipickState.Objects[mobipickState.inGrasp];
+        ostr << " Obj. " << o.id << ", Type = ";
+        if(o.type == F_CYL)
             ostr << " Cylinder";
         else
             ostr << " Not cylinder";
         
-        cout << ", P(cyl) = " << mobipickState.inGrasp.ProbCyl;
+        cout << ", P(cyl) = " << o.ProbCyl;
     }
     else{
         ostr << " Nothing";
@@ -1114,8 +1142,9 @@ void MOBIPICK::DisplayState(const STATE& state, std::ostream& ostr) const
     
     int cyl = 0;
     int noCyl = 0;
-    for(auto o : mobipickState.Basket.Objects){
-        if(o.type == F_CYL) cyl++;
+    for(int i = 0; i < NumObjects; i++){
+        if(mobipickState.Objects[i].Location != MOBIPICK_STATE::L_BASKET) continue;
+        if(mobipickState.Objects[i].type == F_CYL) cyl++;
         else noCyl++;
     }
     
@@ -1127,9 +1156,10 @@ void MOBIPICK::DisplayState(const STATE& state, std::ostream& ostr) const
     
     //Display content of all tables
     ostr << "Table\tO. ID\tP(Pos)\tP.Known\tP(Cyl)\tType" << endl;
-    for(auto t : mobipickState.Tables){
-        for(auto o : t.Objects){
-            ostr << t.id << "\t";
+    for(int t = 0; t < NumTables; t++){
+        for(int i = 0; i < mobipickState.TableSize(t); i++){
+            const MOBIPICK_STATE::OBJECT& o = mobipickState.TableObject(t, i);
+            ostr << t << "\t";
             ostr << o.id << "\t";
             ostr << std::setprecision(4) << o.ProbPos << "\t";
             if(o.PosKnown)
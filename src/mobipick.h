@@ -45,23 +45,33 @@ struct MOBIPICK_PARAMS : PROBLEM_PARAMS{
                     entropy(0.5), PGSAlpha(10){}
 };
 
-//TODO: Add array destructor
+/*
+ * Flat state: all objects live in one array indexed by id, and Location says
+ * whether each one is on a table, in the gripper or in the basket.  Objects on
+ * tables are also listed in Order, grouped by table and kept in placement
+ * order, so that each table is the range [TableStart[t], TableStart[t+1]).
+ * Slot is the position of an object within Order.
+ * */
 class MOBIPICK_STATE : public STATE
 {
 public:
-    int AgentPose;    
-    
-    //Currently not in use
-    struct LOCATION{
-        int x;
-        int y;
+    static const int MaxObjects = 64;
+    static const int MaxTables = 16;
+
+    //Object locations other than tables (table ids are >= 0)
+    enum{
+        L_GRASP = -1,
+        L_BASKET = -2
     };
 
+    int AgentPose;    
+    
     struct OBJECT{
         //Ground truth:
         int id;
-        LOCATION loc; //Location within table
         int type; //{cyl, no cyl}
+        int Location; //Table id, L_GRASP or L_BASKET
+        int Slot; //Position in Order, -1 if not on a table
         
         //POMDP:
         int measured;
@@ -79,85 +89,24 @@ public:
         double LikelihoodNotPos;
         
         bool active;
-        
-        OBJECT(){}
-        
-        OBJECT(const MOBIPICK_STATE::OBJECT& o){
-            id = o.id;
-            loc.x = o.loc.y;
-            loc.y = o.loc.y;
-            type = o.type;
-            measured = o.measured;
-            count = o.count;
-            
-            ProbCyl = o.ProbCyl;            
-            LikelihoodCyl = o.LikelihoodCyl;
-            LikelihoodNotCyl = o.LikelihoodNotCyl;
-            
-            PosKnown = o.PosKnown;
-            ProbPos = o.ProbPos;
-            LikelihoodPos = o.LikelihoodPos;
-            LikelihoodNotPos = o.LikelihoodNotPos;
-            
-            active = o.active;
-        }
-        
-        void copy(const MOBIPICK_STATE::OBJECT& o){
-            id = o.id;
-            loc.x = o.loc.y;
-            loc.y = o.loc.y;
-            type = o.type;
-            measured = o.measured;
-            count = o.count;
-            
-            ProbCyl = o.ProbCyl;            
-            LikelihoodCyl = o.LikelihoodCyl;
-            LikelihoodNotCyl = o.LikelihoodNotCyl;
-            
-            PosKnown = o.PosKnown;
-            ProbPos = o.ProbPos;
-            LikelihoodPos = o.LikelihoodPos;
-            LikelihoodNotPos = o.LikelihoodNotPos;
-            
-            active = o.active;
-        }
-    };
-    
-    OBJECT inGrasp;
-    bool grasping = false;
-    
-    struct TABLE
-    {
-        int id;
-        LOCATION loc; //will not change
-        int sizeX, sizeY;
-        std::vector<OBJECT> Objects;
     };
-    std::vector<TABLE> Tables;
+    OBJECT Objects[MaxObjects];
     
-    //Obstacles not yet implemented
-    struct OBSTACLE
-    {
-        int id;
-        int pose;
-    };
-    std::vector<OBSTACLE> Obstacles;
+    int Order[MaxObjects]; //Ids of objects on tables, grouped by table
+    int TableStart[MaxTables + 1];
     
-    struct BASKET_S
-    {
-        int pose;
-        int capacity; //Make goal more challenging by limiting size
-        LOCATION loc;
-        std::vector<OBJECT> Objects; //Maybe just keep count and remove object structs
-    };
-    BASKET_S Basket;
+    int inGrasp; //Id of object in grasp
+    bool grasping;
+    int BasketCount; //Objects placed in the basket
+
+    int TableSize(int table) const { return TableStart[table + 1] - TableStart[table]; }
+    OBJECT& TableObject(int table, int i) { return Objects[Order[TableStart[table] + i]]; }
+    const OBJECT& TableObject(int table, int i) const { return Objects[Order[TableStart[table] + i]]; }
 
     void activateFeature(int feature, bool status);
-    
-    ~MOBIPICK_STATE();
 };
 
-class MOBIPICK : public SIMULATOR{
+class MOBIPICK final : public SIMULATOR{
 public:
 
     MOBIPICK(PROBLEM_PARAMS& problem_params);
@@ -177,6 +126,15 @@ public:
     //Step with PGS rewards
     bool StepPGS(STATE& state, int action,
                  int& observation, double& reward) const;
+    //Step for rollout level LEVEL, chosen at compile time by the search
+    template <int LEVEL>
+    bool StepLevel(STATE& state, int action,
+                 int& observation, double& reward) const
+    {
+        if (LEVEL >= KNOWLEDGE::PGS)
+            return StepPGS(state, action, observation, reward);
+        return StepNormal(state, action, observation, reward);
+    }
     // Simple Step (transition only)
     bool SimpleStep(STATE& state, int action) const;
     //PGS Rollout policy
@@ -202,6 +160,11 @@ public:
                            std::vector<int>& legal, const STATUS& status) const;
     virtual bool LocalMove(STATE& state, const HISTORY& history,
                            int stepObservation, const STATUS& status) const;
+    virtual bool ConditionedMove(STATE& state, const HISTORY& history,
+                                 int stepObservation, const STATUS& status) const;
+    virtual bool RolloutHistory() const { return false; } //Rollout policies only read the state
+    virtual void TrimMemory() const { MemoryPool.Trim(); }
+    virtual void DisplayMemory(std::ostream& ostr) const { MemoryPool.DisplayStatistics("State", ostr); }
 
     virtual void DisplayBeliefs(const BELIEF_STATE& beliefState,
                                 std::ostream& ostr) const;
@@ -245,6 +208,8 @@ protected:
     /* Mobipick domain functions */
     int Perceive(int pose) const; //Get poses of all objects in nearby table
     int Identify(MOBIPICK_STATE::OBJECT& o_ptr) const; //Get type of object scanned
+    void RemoveFromTable(MOBIPICK_STATE& mobipickState, int obj) const; //Take object off its table
+    void PlaceOnTable(MOBIPICK_STATE& mobipickState, int obj, int table) const; //Append object to table
     std::string Pose2Str(int pose) const; //Return text representation of pose
     
     /*
@@ -259,6 +224,7 @@ protected:
     double PROB_GRASP_OTHER; //Grasp prob. for non cylinders
     double PROB_MOVING;
     double BIN_ENTROPY_LIMIT; //0.5 or set to preference
+    double EntropyBound, IdentifyBound; //p <= bound or p >= 1 - bound satisfies the limit
     double ACTIVATION_THRESHOLD;
     double PGSAlpha; //PGS scaling factor
     
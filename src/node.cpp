@@ -57,6 +57,8 @@ MEMORY_POOL<VNODE> VNODE::VNodePool;
 
 int VNODE::NumChildren = 0;
 
+const int VNODE::PrefetchBytes;
+
 void VNODE::Initialise()
 {
     assert(NumChildren);
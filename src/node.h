@@ -111,6 +111,9 @@ public:
     static VNODE* Create();
     static void Free(VNODE* vnode, const SIMULATOR& simulator);
     static void FreeAll();
+    static int GetNumAllocated() { return VNodePool.GetNumAllocated(); }
+    static void TrimPool() { VNodePool.Trim(); }
+    static void DisplayPool(std::ostream& ostr) { VNodePool.DisplayStatistics("Node", ostr); }
 
     QNODE& Child(int c) { return Children[c]; }
     const QNODE& Child(int c) const { return Children[c]; }
@@ -119,6 +122,17 @@ public:
 
     void SetChildren(int count, double value);
 
+    // Prefetch the node and the action array the next UCB selection scans,
+    // which is allocated apart from the node
+    void Prefetch() const
+    {
+        __builtin_prefetch(this);
+        const char* children = reinterpret_cast<const char*>(Children.data());
+        int bytes = std::min<int>(Children.size() * sizeof(QNODE), PrefetchBytes);
+        for (int offset = 0; offset < bytes; offset += 64)
+            __builtin_prefetch(children + offset);
+    }
+
     void DisplayValue(HISTORY& history, int maxDepth, std::ostream& ostr) const;
     void DisplayPolicy(HISTORY& history, int maxDepth, std::ostream& ostr) const;
 
@@ -129,6 +143,7 @@ private:
     std::vector<QNODE> Children;
     BELIEF_STATE BeliefState;
     static MEMORY_POOL<VNODE> VNodePool;
+    static const int PrefetchBytes = 1024; // Cap on the action array prefetch
 };
 
 #endif // NODE_H
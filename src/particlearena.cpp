@@ -0,0 +1,105 @@
+#include "particlearena.h"
+#include "simulator.h"
+#include <cassert>
+
+PARTICLE_ARENA::PARTICLE_ARENA()
+:   Generation(0)
+{
+}
+
+int PARTICLE_ARENA::Acquire(const STATE& state, const SIMULATOR& simulator)
+{
+    std::size_t hash = 0;
+    bool hashed = simulator.Hash(state, hash);
+    if (hashed)
+    {
+        std::pair<std::unordered_multimap<std::size_t, int>::const_iterator,
+            std::unordered_multimap<std::size_t, int>::const_iterator> range = Index.equal_range(hash);
+        for (std::unordered_multimap<std::size_t, int>::const_iterator i_entry = range.first;
+                i_entry != range.second; ++i_entry)
+        {
+            if (simulator.Equal(*States[i_entry->second], state))
+            {
+                RefCounts[i_entry->second]++;
+                return i_entry->second;
+            }
+        }
+    }
+
+    int handle;
+    if (FreeSlots.empty())
+    {
+        handle = States.size();
+        States.push_back(0);
+        RefCounts.push_back(0);
+        Hashes.push_back(0);
+        Hashed.push_back(false);
+    }
+    else
+    {
+        handle = FreeSlots.back();
+        FreeSlots.pop_back();
+    }
+
+    States[handle] = simulator.Copy(state);
+    RefCounts[handle] = 1;
+    Hashes[handle] = hash;
+    Hashed[handle] = hashed;
+    if (hashed)
+        Index.insert(std::make_pair(hash, handle));
+    return handle;
+}
+
+void PARTICLE_ARENA::Release(int handle, const SIMULATOR& simulator)
+{
+    assert(RefCounts[handle] > 0);
+    if (--RefCounts[handle] > 0)
+        return;
+    simulator.FreeState(States[handle]);
+    Remove(handle);
+}
+
+STATE* PARTICLE_ARENA::Detach(int handle, const SIMULATOR& simulator)
+{
+    assert(RefCounts[handle] > 0);
+    if (--RefCounts[handle] > 0)
+        return simulator.Copy(*States[handle]);
+    STATE* state = States[handle];
+    Remove(handle);
+    return state;
+}
+
+void PARTICLE_ARENA::Clear(const SIMULATOR& simulator)
+{
+    for (int handle = 0; handle < (int) States.size(); ++handle)
+        if (States[handle])
+            simulator.FreeState(States[handle]);
+    States.clear();
+    RefCounts.clear();
+    Hashes.clear();
+    Hashed.clear();
+    FreeSlots.clear();
+    Index.clear();
+    Generation++;
+}
+
+void PARTICLE_ARENA::Remove(int handle)
+{
+    if (Hashed[handle])
+    {
+        std::pair<std::unordered_multimap<std::size_t, int>::iterator,
+            std::unordered_multimap<std::size_t, int>::iterator> range = Index.equal_range(Hashes[handle]);
+        for (std::unordered_multimap<std::size_t, int>::iterator i_entry = range.first;
+                i_entry != range.second; ++i_entry)
+        {
+            if (i_entry->second == handle)
+            {
+                Index.erase(i_entry);
+                break;
+            }
+        }
+    }
+    States[handle] = 0;
+    RefCounts[handle] = 0;
+    FreeSlots.push_back(handle);
+}
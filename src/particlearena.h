@@ -0,0 +1,58 @@
+#ifndef PARTICLE_ARENA_H
+#define PARTICLE_ARENA_H
+
+#include <vector>
+#include <unordered_map>
+#include <cstddef>
+#include <stdint.h>
+
+class STATE;
+class SIMULATOR;
+
+/*
+    Particles of the search tree, shared between node beliefs.
+    Nodes refer to a particle by its 32-bit handle (slot index). Equal
+    states (SIMULATOR::Hash/Equal) are stored once and reference counted,
+    slots of released particles are reused.
+
+    Clear discards all particles at once when the tree is re-rooted and
+    starts a new generation, so that beliefs still holding handles of the
+    old tree can tell they no longer own anything.
+*/
+class PARTICLE_ARENA
+{
+public:
+
+    PARTICLE_ARENA();
+
+    // Handle of a particle equal to state, copied into the arena if needed
+    int Acquire(const STATE& state, const SIMULATOR& simulator);
+
+    // Drop one reference, the particle is freed with the last one
+    void Release(int handle, const SIMULATOR& simulator);
+
+    // Drop one reference and return a state owned by the caller,
+    // taken over from the arena if this was the last reference
+    STATE* Detach(int handle, const SIMULATOR& simulator);
+
+    // Free all particles
+    void Clear(const SIMULATOR& simulator);
+
+    const STATE* Get(int handle) const { return States[handle]; }
+    uint32_t GetGeneration() const { return Generation; }
+    int GetNumParticles() const { return States.size() - FreeSlots.size(); }
+
+private:
+
+    void Remove(int handle);
+
+    std::vector<STATE*> States;
+    std::vector<int> RefCounts;
+    std::vector<std::size_t> Hashes;
+    std::vector<bool> Hashed;
+    std::vector<int> FreeSlots;
+    std::unordered_multimap<std::size_t, int> Index;
+    uint32_t Generation;
+};
+
+#endif // PARTICLE_ARENA_H
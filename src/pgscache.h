@@ -0,0 +1,130 @@
+#ifndef PGS_CACHE_H
+#define PGS_CACHE_H
+
+#include <atomic>
+#include <vector>
+#include <stdint.h>
+
+/*
+    Bounded cache from a rollout-relevant state key to the argmax PGS
+    action set. The table is direct-mapped with a fixed number of slots,
+    so newer entries simply overwrite older ones. Each slot is protected
+    by a sequence counter (seqlock): readers never block and discard
+    entries that were written concurrently, writers skip busy slots.
+
+    Note that GeneratePGS samples observations for check actions, so a
+    cached entry stores one evaluation of the (stochastic) argmax set.
+    Keys are hashes, so callers check a hit against the state and Reject
+    it if the actions cannot belong to that state.
+*/
+class PGS_CACHE
+{
+public:
+
+    static const int MaxActions = 32;
+
+    PGS_CACHE(int numSlotsLog2 = 16)
+    :   NumSlots(1 << numSlotsLog2),
+        Slots(new SLOT[1 << numSlotsLog2])
+    {
+        ClearStatistics();
+    }
+
+    ~PGS_CACHE()
+    {
+        delete[] Slots;
+    }
+
+    bool Lookup(uint64_t key, std::vector<int>& actions) const
+    {
+        const SLOT& slot = Slots[key & (NumSlots - 1)];
+        uint32_t sequence = slot.Sequence.load(std::memory_order_acquire);
+        if ((sequence & 1) || slot.Key.load(std::memory_order_relaxed) != key)
+        {
+            Misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        int numActions = slot.NumActions.load(std::memory_order_relaxed);
+        int16_t buffer[MaxActions];
+        for (int i = 0; i < numActions; ++i)
+            buffer[i] = slot.Actions[i].load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (numActions == 0 || slot.Sequence.load(std::memory_order_relaxed) != sequence)
+        {
+            Misses.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        actions.insert(actions.end(), buffer, buffer + numActions);
+        Hits.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void Insert(uint64_t key, const std::vector<int>& actions)
+    {
+        if (actions.empty() || (int) actions.size() > MaxActions)
+            return;
+
+        SLOT& slot = Slots[key & (NumSlots - 1)];
+        uint32_t sequence = slot.Sequence.load(std::memory_order_relaxed);
+        if ((sequence & 1) || !slot.Sequence.compare_exchange_strong(sequence, sequence + 1,
+                std::memory_order_acquire, std::memory_order_relaxed))
+            return; // Another writer owns this slot
+        std::atomic_thread_fence(std::memory_order_release);
+
+        slot.Key.store(key, std::memory_order_relaxed);
+        slot.NumActions.store(actions.size(), std::memory_order_relaxed);
+        for (int i = 0; i < (int) actions.size(); ++i)
+            slot.Actions[i].store(actions[i], std::memory_order_relaxed);
+
+        slot.Sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Count the last hit as a miss, after its actions failed the caller's check
+    void Reject() const
+    {
+        Hits.fetch_sub(1, std::memory_order_relaxed);
+        Misses.fetch_add(1, std::memory_order_relaxed);
+        Rejects.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void ClearStatistics() const
+    {
+        Hits.store(0, std::memory_order_relaxed);
+        Misses.store(0, std::memory_order_relaxed);
+        Rejects.store(0, std::memory_order_relaxed);
+    }
+
+    long long GetHits() const { return Hits.load(std::memory_order_relaxed); }
+    long long GetMisses() const { return Misses.load(std::memory_order_relaxed); }
+    long long GetRejects() const { return Rejects.load(std::memory_order_relaxed); }
+
+    double GetHitRate() const
+    {
+        long long total = GetHits() + GetMisses();
+        return total ? (double) GetHits() / total : 0.0;
+    }
+
+private:
+
+    struct SLOT
+    {
+        SLOT() : Sequence(0), Key(0), NumActions(0) {}
+
+        std::atomic<uint32_t> Sequence;
+        std::atomic<uint64_t> Key;
+        std::atomic<int> NumActions;
+        std::atomic<int16_t> Actions[MaxActions];
+    };
+
+    PGS_CACHE(const PGS_CACHE&);
+    PGS_CACHE& operator=(const PGS_CACHE&);
+
+    const uint64_t NumSlots;
+    SLOT* Slots;
+    mutable std::atomic<long long> Hits, Misses, Rejects;
+};
+
+#endif // PGS_CACHE_H
@@ -11,8 +11,11 @@ ROCKSAMPLE::ROCKSAMPLE(int size, int rocks)
     Size(size),
     NumRocks(rocks),
     SmartMoveProb(0.95),
-    UncertaintyCount(0)
+    UncertaintyCount(0),
+    PGSAlpha(10.0)
 {
+    assert(NumRocks <= ROCKSAMPLE_STATE::MaxRocks);
+    AllRocks = NumRocks == ROCKSAMPLE_STATE::MaxRocks ? ~(uint64_t) 0 : ROCKSAMPLE_STATE::Bit(NumRocks) - 1;
     NumActions = NumRocks + 5;
     NumObservations = 3;
     RewardRange = 20;
@@ -26,6 +29,21 @@ ROCKSAMPLE::ROCKSAMPLE(int size, int rocks)
         Init_11_11();
     else
         InitGeneral();
+
+    InitEfficiency();
+    UncertainProb = BinaryEntropyBound(0.5);
+}
+
+void ROCKSAMPLE::InitEfficiency()
+{
+    // Sensor efficiency only depends on the offset to the rock
+    Efficiency.Resize(Size, Size);
+    for (int x = 0; x < Size; ++x)
+        for (int y = 0; y < Size; ++y)
+        {
+            double distance = COORD::EuclideanDistance(COORD(0, 0), COORD(x, y));
+            Efficiency(x, y) = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
+        }
 }
 
 void ROCKSAMPLE::InitGeneral()
@@ -109,10 +127,53 @@ STATE* ROCKSAMPLE::Copy(const STATE& state) const
 {
     const ROCKSAMPLE_STATE& rockstate = safe_cast<const ROCKSAMPLE_STATE&>(state);
     ROCKSAMPLE_STATE* newstate = MemoryPool.Allocate();
-    *newstate = rockstate;
+    newstate->AgentPos = rockstate.AgentPos;
+    newstate->Valuable = rockstate.Valuable;
+    newstate->Collected = rockstate.Collected;
+    newstate->Checked = rockstate.Checked;
+    newstate->Counted = rockstate.Counted;
+    newstate->Uncertain = rockstate.Uncertain;
+    newstate->Target = rockstate.Target;
+    std::copy(rockstate.Count, rockstate.Count + NumRocks, newstate->Count);
+    std::copy(rockstate.Measured, rockstate.Measured + NumRocks, newstate->Measured);
+    std::copy(rockstate.ProbValuable, rockstate.ProbValuable + NumRocks, newstate->ProbValuable);
     return newstate;
 }
 
+bool ROCKSAMPLE::Hash(const STATE& state, std::size_t& hash) const
+{
+    const ROCKSAMPLE_STATE& rockstate = safe_cast<const ROCKSAMPLE_STATE&>(state);
+    hash = 0;
+    HashCombine(hash, rockstate.AgentPos.X);
+    HashCombine(hash, rockstate.AgentPos.Y);
+    HashCombine(hash, rockstate.Target);
+    HashCombine(hash, rockstate.Valuable);
+    HashCombine(hash, rockstate.Collected);
+    for (int i = 0; i < NumRocks; i++)
+    {
+        HashCombine(hash, rockstate.Count[i]);
+        HashCombine(hash, rockstate.Measured[i]);
+        HashCombine(hash, rockstate.ProbValuable[i]);
+    }
+    return true;
+}
+
+bool ROCKSAMPLE::Equal(const STATE& state1, const STATE& state2) const
+{
+    const ROCKSAMPLE_STATE& rockstate1 = safe_cast<const ROCKSAMPLE_STATE&>(state1);
+    const ROCKSAMPLE_STATE& rockstate2 = safe_cast<const ROCKSAMPLE_STATE&>(state2);
+    if (rockstate1.AgentPos != rockstate2.AgentPos || rockstate1.Target != rockstate2.Target
+        || rockstate1.Valuable != rockstate2.Valuable || rockstate1.Collected != rockstate2.Collected)
+        return false;
+    for (int i = 0; i < NumRocks; i++)
+    {
+        if (rockstate1.Count[i] != rockstate2.Count[i] || rockstate1.Measured[i] != rockstate2.Measured[i]
+            || rockstate1.ProbValuable[i] != rockstate2.ProbValuable[i])
+            return false;
+    }
+    return true;
+}
+
 void ROCKSAMPLE::Validate(const STATE& state) const
 {
     const ROCKSAMPLE_STATE& rockstate = safe_cast<const ROCKSAMPLE_STATE&>(state);
@@ -123,18 +184,18 @@ STATE* ROCKSAMPLE::CreateStartState() const
 {
     ROCKSAMPLE_STATE* rockstate = MemoryPool.Allocate();
     rockstate->AgentPos = StartPos;
-    rockstate->Rocks.clear();
+    rockstate->Valuable = 0;
+    rockstate->Collected = 0;
+    rockstate->Checked = 0;
+    rockstate->Counted = 0;
+    rockstate->Uncertain = 0;
     for (int i = 0; i < NumRocks; i++)
     {
-        ROCKSAMPLE_STATE::ENTRY entry;
-        entry.Collected = false;
-        entry.Valuable = Bernoulli(0.5);
-        entry.Count = 0;
-        entry.Measured = 0;
-        entry.ProbValuable = 0.5;
-        entry.LikelihoodValuable = 1.0;
-        entry.LikelihoodWorthless = 1.0;
-        rockstate->Rocks.push_back(entry);
+        if (Bernoulli(0.5))
+            rockstate->Valuable |= ROCKSAMPLE_STATE::Bit(i);
+        rockstate->Count[i] = 0;
+        rockstate->Measured[i] = 0;
+        rockstate->ProbValuable[i] = 0.5;
     }
     rockstate->Target = SelectTarget(*rockstate);
     return rockstate;
@@ -165,7 +226,6 @@ bool ROCKSAMPLE::Step(STATE& state, int action,
 bool ROCKSAMPLE::StepPGS(STATE& state, int action,
     int& observation, double& reward) const
 {
-	double scale = 10.0;
 	double r = 0.0;
 	double r2 = 0.0;
 	STATE* oldstate = Copy(state);	
@@ -180,7 +240,7 @@ bool ROCKSAMPLE::StepPGS(STATE& state, int action,
 		
 		//cout << "reward = " << reward << ", r1 = " << r << ", r2 = " << r2 << endl;
 				
-		reward += scale*r - scale*r2;
+		reward += PGSAlpha*r - PGSAlpha*r2;
 	}
 	FreeState(oldstate);
 	
@@ -227,10 +287,8 @@ bool ROCKSAMPLE::SimpleStep(STATE& state, int action) const
     if (action == E_SAMPLE) // sample
     {
         int rock = Grid(rockstate.AgentPos);
-        if (rock >= 0 && !rockstate.Rocks[rock].Collected)
-        {
-            rockstate.Rocks[rock].Collected = true;
-        }
+        if (rock >= 0)
+            rockstate.Collected |= ROCKSAMPLE_STATE::Bit(rock);
     }
 
     if (action > E_SAMPLE) // check
@@ -238,27 +296,8 @@ bool ROCKSAMPLE::SimpleStep(STATE& state, int action) const
         int rock = action - E_SAMPLE - 1;
         assert(rock < NumRocks);
         observation = GetObservation(rockstate, rock);
-        rockstate.Rocks[rock].Measured++;
-
-        double distance = COORD::EuclideanDistance(rockstate.AgentPos, RockPos[rock]);
-    	double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
 
-        if (observation == E_GOOD)
-        {
-            rockstate.Rocks[rock].Count++;
-            rockstate.Rocks[rock].LikelihoodValuable *= efficiency;
-            rockstate.Rocks[rock].LikelihoodWorthless *= 1.0 - efficiency;
-
-        }
-        else
-        {
-            rockstate.Rocks[rock].Count--;
-            rockstate.Rocks[rock].LikelihoodWorthless *= efficiency;
-            rockstate.Rocks[rock].LikelihoodValuable *= 1.0 - efficiency;
-		}
-		double denom = (0.5 * rockstate.Rocks[rock].LikelihoodValuable) +
-			(0.5 * rockstate.Rocks[rock].LikelihoodWorthless);
-		rockstate.Rocks[rock].ProbValuable = (0.5 * rockstate.Rocks[rock].LikelihoodValuable) / denom;
+        UpdateCheck(rockstate, rock, observation, CheckEfficiency(rockstate.AgentPos, RockPos[rock]));
     }
 
     if (rockstate.Target < 0 || rockstate.AgentPos == RockPos[rockstate.Target])
@@ -316,13 +355,10 @@ bool ROCKSAMPLE::StepNormal(STATE& state, int action,
     if (action == E_SAMPLE) // sample
     {
         int rock = Grid(rockstate.AgentPos);
-        if (rock >= 0 && !rockstate.Rocks[rock].Collected)
+        if (rock >= 0 && !rockstate.IsCollected(rock))
         {
-            rockstate.Rocks[rock].Collected = true;
-            if (rockstate.Rocks[rock].Valuable)
-                reward = +10;
-            else
-                reward = -10;
+            rockstate.Collected |= ROCKSAMPLE_STATE::Bit(rock);
+            reward = rockstate.IsValuable(rock) ? +10 : -10;
         }
         else
         {
@@ -335,27 +371,8 @@ bool ROCKSAMPLE::StepNormal(STATE& state, int action,
         int rock = action - E_SAMPLE - 1;
         assert(rock < NumRocks);
         observation = GetObservation(rockstate, rock);
-        rockstate.Rocks[rock].Measured++;
-
-        double distance = COORD::EuclideanDistance(rockstate.AgentPos, RockPos[rock]);
-    	double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
-
-        if (observation == E_GOOD)
-        {
-            rockstate.Rocks[rock].Count++;
-            rockstate.Rocks[rock].LikelihoodValuable *= efficiency;
-            rockstate.Rocks[rock].LikelihoodWorthless *= 1.0 - efficiency;
 
-        }
-        else
-        {
-            rockstate.Rocks[rock].Count--;
-            rockstate.Rocks[rock].LikelihoodWorthless *= efficiency;
-            rockstate.Rocks[rock].LikelihoodValuable *= 1.0 - efficiency;
-		}
-		double denom = (0.5 * rockstate.Rocks[rock].LikelihoodValuable) +
-			(0.5 * rockstate.Rocks[rock].LikelihoodWorthless);
-		rockstate.Rocks[rock].ProbValuable = (0.5 * rockstate.Rocks[rock].LikelihoodValuable) / denom;
+        UpdateCheck(rockstate, rock, observation, CheckEfficiency(rockstate.AgentPos, RockPos[rock]));
     }
 
     if (rockstate.Target < 0 || rockstate.AgentPos == RockPos[rockstate.Target])
@@ -365,12 +382,110 @@ bool ROCKSAMPLE::StepNormal(STATE& state, int action,
     return false;
 }
 
+/*
+    Batched step. Moves and samples go through StepNormal, check actions
+    are gathered into flat arrays (efficiency lookups, random draws)
+    and resolved in separate tight loops over all particles.
+*/
+void ROCKSAMPLE::StepBatch(STATE** states, const int* actions,
+    int* observations, double* rewards, bool* terminal, int n) const
+{
+    static thread_local std::vector<STATE*> oldstates;
+    static thread_local std::vector<int> checks;
+    static thread_local std::vector<double> efficiency;
+    static thread_local std::vector<int> draws;
+
+    bool pgs = Knowledge.RolloutLevel >= KNOWLEDGE::PGS;
+    if (pgs)
+    {
+        oldstates.resize(n);
+        for (int i = 0; i < n; ++i)
+            oldstates[i] = Copy(*states[i]);
+    }
+
+    checks.clear();
+    for (int i = 0; i < n; ++i)
+    {
+        if (actions[i] > E_SAMPLE)
+            checks.push_back(i);
+        else
+        {
+            bool result = StepNormal(*states[i], actions[i], observations[i], rewards[i]);
+            if (terminal)
+                terminal[i] = result;
+        }
+    }
+
+    int numChecks = checks.size();
+    efficiency.resize(numChecks);
+    draws.resize(numChecks);
+    for (int k = 0; k < numChecks; ++k)
+    {
+        const ROCKSAMPLE_STATE& rockstate = safe_cast<const ROCKSAMPLE_STATE&>(*states[checks[k]]);
+        efficiency[k] = CheckEfficiency(rockstate.AgentPos, RockPos[actions[checks[k]] - E_SAMPLE - 1]);
+    }
+    for (int k = 0; k < numChecks; ++k)
+        draws[k] = Rand();
+
+    for (int k = 0; k < numChecks; ++k)
+    {
+        int i = checks[k];
+        int rock = actions[i] - E_SAMPLE - 1;
+        ROCKSAMPLE_STATE& rockstate = safe_cast<ROCKSAMPLE_STATE&>(*states[i]);
+
+        bool correct = draws[k] < efficiency[k] * RAND_MAX;
+        observations[i] = (correct == rockstate.IsValuable(rock)) ? E_GOOD : E_BAD;
+        UpdateCheck(rockstate, rock, observations[i], efficiency[k]);
+
+        if (rockstate.Target < 0 || rockstate.AgentPos == RockPos[rockstate.Target])
+            rockstate.Target = SelectTarget(rockstate);
+        rewards[i] = 0;
+        if (terminal)
+            terminal[i] = false;
+    }
+
+    // Potential-based reward bonus, as in StepPGS
+    if (pgs)
+    {
+        for (int i = 0; i < n; ++i)
+        {
+            if (rewards[i] != -100)
+            {
+                double r2 = PGS(*oldstates[i]);
+                double r = PGS_RO(*oldstates[i], *states[i], actions[i], r2);
+                rewards[i] += PGSAlpha*r - PGSAlpha*r2;
+            }
+            FreeState(oldstates[i]);
+        }
+    }
+}
+
+void ROCKSAMPLE::UpdateCheck(ROCKSAMPLE_STATE& rockstate, int rock,
+    int observation, double efficiency) const
+{
+    // Bayes update of P(valuable), with uniform prior
+    double likelihoodValuable = (observation == E_GOOD) ? efficiency : 1.0 - efficiency;
+    double joint = rockstate.ProbValuable[rock] * likelihoodValuable;
+    rockstate.ProbValuable[rock] = joint / (joint + (1.0 - rockstate.ProbValuable[rock]) * (1.0 - likelihoodValuable));
+    rockstate.Count[rock] += (observation == E_GOOD) ? 1 : -1;
+    rockstate.Measured[rock]++;
+
+    // Flags read by PGS. Binary entropy > 0.5 is the same as p lying
+    // strictly between UncertainProb and 1 - UncertainProb
+    uint64_t bit = ROCKSAMPLE_STATE::Bit(rock);
+    double p = rockstate.ProbValuable[rock];
+    bool uncertain = HighEntropy(p, UncertainProb);
+    rockstate.Checked |= bit;
+    rockstate.Counted = (rockstate.Counted & ~bit) | (rockstate.Count[rock] != 0 ? bit : 0);
+    rockstate.Uncertain = (rockstate.Uncertain & ~bit) | (uncertain ? bit : 0);
+}
+
 bool ROCKSAMPLE::LocalMove(STATE& state, const HISTORY& history,
     int stepObs, const STATUS& status) const
 {
     ROCKSAMPLE_STATE& rockstate = safe_cast<ROCKSAMPLE_STATE&>(state);
     int rock = Random(NumRocks);
-    rockstate.Rocks[rock].Valuable = !rockstate.Rocks[rock].Valuable;
+    rockstate.Valuable ^= ROCKSAMPLE_STATE::Bit(rock);
 
     if (history.Back().Action > E_SAMPLE) // check rock
     {
@@ -384,9 +499,13 @@ bool ROCKSAMPLE::LocalMove(STATE& state, const HISTORY& history,
 
         // Update counts to be consistent with real observation
         if (realObs == E_GOOD && stepObs == E_BAD)
-            rockstate.Rocks[rock].Count += 2;
+            rockstate.Count[rock] += 2;
         if (realObs == E_BAD && stepObs == E_GOOD)
-            rockstate.Rocks[rock].Count -= 2;
+            rockstate.Count[rock] -= 2;
+        if (rockstate.Count[rock] != 0)
+            rockstate.Counted |= ROCKSAMPLE_STATE::Bit(rock);
+        else
+            rockstate.Counted &= ~ROCKSAMPLE_STATE::Bit(rock);
     }
     return true;
 }
@@ -408,37 +527,9 @@ double ROCKSAMPLE::PGS_RO(STATE& oldstate, STATE& state, int action, double oldp
 		rock = action - E_SAMPLE - 1;
 	
 	if(rock >= 0){
-		//Points for current state
-		if(rockstate.Rocks[rock].Collected){
-			if (rockstate.Rocks[rock].Valuable){
-				if(rockstate.Rocks[rock].Count)
-					points++; //+1 for sampling rocks w/ good observations
-			}
-			else points--;
-		}
-		else{
-			if(rockstate.Rocks[rock].Measured){			
-				double p = rockstate.Rocks[rock].ProbValuable;
-				double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);			
-				if(binaryEntropy > 0.5) points--;						
-			}
-		}
-		
-		//Points for previous state
-		if(oldrockstate.Rocks[rock].Collected){
-			if (oldrockstate.Rocks[rock].Valuable){
-				if(oldrockstate.Rocks[rock].Count)
-					oldpoints++; //+1 for sampling rocks w/ good observations
-			}
-			else oldpoints--;
-		}
-		else{
-			if(oldrockstate.Rocks[rock].Measured){			
-				double p = oldrockstate.Rocks[rock].ProbValuable;
-				double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);			
-				if(binaryEntropy > 0.5) oldpoints--;						
-			}
-		}
+		//Points for current and previous state
+		points = RockPoints(rockstate, ROCKSAMPLE_STATE::Bit(rock));
+		oldpoints = RockPoints(oldrockstate, ROCKSAMPLE_STATE::Bit(rock));
 	}
 	//Update difference for current rock
 	double result = oldpgs - oldpoints + points;
@@ -447,12 +538,12 @@ double ROCKSAMPLE::PGS_RO(STATE& oldstate, STATE& state, int action, double oldp
 	//2. Sample
 	if(action == E_SAMPLE){
 		int rock = Grid(rockstate.AgentPos);
-		double p = oldrockstate.Rocks[rock].ProbValuable;
+		double p = oldrockstate.ProbValuable[rock];
 		double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);
 		
-		if(rockstate.Rocks[rock].Valuable){
+		if(rockstate.IsValuable(rock)){
 			if(binaryEntropy > 0.5) points++;
-			if(rockstate.Rocks[rock].Count) points++;
+			if(rockstate.Count[rock]) points++;
 		}
 		else{
 			if(binaryEntropy <= 0.5) points--;
@@ -463,13 +554,13 @@ double ROCKSAMPLE::PGS_RO(STATE& oldstate, STATE& state, int action, double oldp
 	if (action > E_SAMPLE){
 		int rock = action - E_SAMPLE - 1;
 		
-		double p = rockstate.Rocks[rock].ProbValuable;
+		double p = rockstate.ProbValuable[rock];
 		double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);
 		
-		double oldP = oldrockstate.Rocks[rock].ProbValuable;
+		double oldP = oldrockstate.ProbValuable[rock];
 		double oldBinaryEntropy = -1*oldP*log2(oldP) - (1-oldP)*log2(1-oldP);
 		
-		if(rockstate.Rocks[rock].Measured == 1){
+		if(rockstate.Measured[rock] == 1){
 			if(binaryEntropy > 0.5) points--;
 		}
 		else{
@@ -478,7 +569,7 @@ double ROCKSAMPLE::PGS_RO(STATE& oldstate, STATE& state, int action, double oldp
 		}
 		
 		//Works OK:
-		//if(binaryEntropy > 0.5 && !oldrockstate.Rocks[rock].Measured || binaryEntropy > 0.5 && oldBinaryEntropy <= 0.5) points--;
+		//if(binaryEntropy > 0.5 && !oldrockstate.Measured[rock] || binaryEntropy > 0.5 && oldBinaryEntropy <= 0.5) points--;
 		//if(oldBinaryEntropy > 0.5 && binaryEntropy <= 0.5) points++;
 	}
 	*/
@@ -495,94 +586,8 @@ double ROCKSAMPLE::PGS(STATE& state) const
 	//1. Cast to rockstate
 	ROCKSAMPLE_STATE& rockstate = safe_cast<ROCKSAMPLE_STATE&>(state);
 	
-	//2. Sample	
-	for(int rock=0; rock < NumRocks; ++rock){
-		if(rockstate.Rocks[rock].Collected){
-			if (rockstate.Rocks[rock].Valuable){
-				if(rockstate.Rocks[rock].Count)
-					points++; //+1 for sampling rocks w/ good observations
-			}
-			else points--;
-		}
-		else{
-			//Penalty:
-			/*double p = rockstate.Rocks[rock].ProbValuable;
-			if(0.1 < p && p < 0.9) points--;
-			*/
-			if(rockstate.Rocks[rock].Measured){			
-				double p = rockstate.Rocks[rock].ProbValuable;
-				double binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);			
-				if(binaryEntropy > 0.5) points--;						
-			}
-			/*if(rockstate.Rocks[rock].Measured){
-				double p = rockstate.Rocks[rock].ProbValuable;
-				points += 1 + p*log2(p) + (1-p)*log2(1-p);
-			}*/
-			/*//double p = rockstate.Rocks[rock].ProbValuable;
-			//points += 1 - (-1*p*log2(p) - (1-p)*log2(1-p));
-			double nMost = 0;
-			double nLeast = 0;
-			double measured = rockstate.Rocks[rock].Measured;
-			double count = fabs(rockstate.Rocks[rock].Count);
-			
-			nMost = (measured + count)/2.0; //get No. of observations
-			nLeast = measured - nMost;
-			
-			//double accuracy = count/measured;
-			
-			double TPR = nMost/measured; //True Positive Rate
-			//points += log2(1 + TPR);*/
-			
-			//Must add points whenever the knowledge about a given rock is more certain.
-			
-			/*if(rockstate.Rocks[rock].Measured){
-				//double diff = fabs(0.5 - rockstate.Rocks[rock].ProbValuable);
-				int count = abs(rockstate.Rocks[rock].Count);
-				double value = 0.0;
-				if(count <= 10) value = 0.25;
-				if(count < 5) value = 0.5;
-				if(count < 3) value = 1.0;		
-				
-				//cout << "rock " << rock << " w/ P = " << rockstate.Rocks[rock].ProbValuable << " and diff " << diff <<" worth " << value << " points." << endl;
-				points+=value;
-			}*/
-		}
-		/*if(rockstate.Rocks[rock].Measured){
-			double nMost = 0;
-			double nLeast = 0;
-			int measured = rockstate.Rocks[rock].Measured;
-			int count = rockstate.Rocks[rock].Count;
-			
-			nMost = (double) measured/2.0 + fabs(count/2.0); //get No. of observations
-			nLeast = measured - nMost;
-			
-			double ratio = 0.5;
-			ratio = nMost / measured;
-			
-			points += 1 + log2(ratio); //estimate information value of observation
-		}*/
-		
-			/*if(fabs(rockstate.Rocks[rock].LikelihoodValuable - rockstate.Rocks[rock].LikelihoodWorthless) > heuristicProbLimit &&
-				rockstate.Rocks[rock].Measured <= 5)
-				points++;
-				*/
-			/*if (rockstate.Rocks[rock].ProbValuable != 0.0 &&
-				rockstate.Rocks[rock].ProbValuable != 1.0 &&
-				rockstate.Rocks[rock].Measured < 5  &&
-				std::abs(rockstate.Rocks[rock].Count) < 2)
-				points++;
-			*/
-			/*if(rockstate.Rocks[rock].Measured >= 5 &&
-				(rockstate.Rocks[rock].ProbValuable < heuristicProbLimit ||
-				(1.0 - heuristicProbLimit) < rockstate.Rocks[rock].ProbValuable)){
-				points++;				
-			}*/
-			//points += 0.5 + fabs(0.5 - rockstate.Rocks[rock].ProbValuable);
-			//points += fabs(rockstate.Rocks[rock].LikelihoodValuable - rockstate.Rocks[rock].LikelihoodWorthless); //Reducing uncertainty?			
-			//if(rockstate.Rocks[rock].ProbValuable > 0)
-			//	points += rockstate.Rocks[rock].ProbValuable; //Fraction for changes in ProbValuable (will punish checking bad rocks, reward checking good ones)
-		//}
-	}
+	//2. Sample
+	points += RockPoints(rockstate, AllRocks);
 	
 	//3. Check	
 
@@ -595,6 +600,34 @@ double ROCKSAMPLE::PGS(STATE& state) const
 	return points;
 }
 
+// PGS points of the given rocks:
+// +1 for sampled valuable rocks w/ good observations, -1 for sampled worthless rocks
+// and -1 for measured rocks that are still uncertain
+int ROCKSAMPLE::RockPoints(const ROCKSAMPLE_STATE& rockstate, uint64_t rocks) const
+{
+	uint64_t collected = rockstate.Collected & rocks;
+	return __builtin_popcountll(collected & rockstate.Valuable & rockstate.Counted)
+		- __builtin_popcountll(collected & ~rockstate.Valuable)
+		- __builtin_popcountll(~rockstate.Collected & rockstate.Uncertain & rocks);
+}
+
+// Everything GenerateLegal, StepNormal and PGS_RO read for the PGS rollout policy
+bool ROCKSAMPLE::RolloutKey(const STATE& state, uint64_t& key) const
+{
+	const ROCKSAMPLE_STATE& rockstate = safe_cast<const ROCKSAMPLE_STATE&>(state);
+	std::size_t hash = 0;
+	HashCombine(hash, rockstate.AgentPos.X);
+	HashCombine(hash, rockstate.AgentPos.Y);
+	HashCombine(hash, rockstate.Valuable);
+	HashCombine(hash, rockstate.Collected);
+	HashCombine(hash, rockstate.Checked);
+	HashCombine(hash, rockstate.Counted);
+	for (uint64_t rocks = ~rockstate.Collected & AllRocks; rocks; rocks &= rocks - 1)
+		HashCombine(hash, rockstate.ProbValuable[__builtin_ctzll(rocks)]);
+	key = hash;
+	return true;
+}
+
 // PGS Rollout policy
 // Computes PGS only for non Checking actions
 void ROCKSAMPLE::GeneratePGS(const STATE& state, const HISTORY& history,
@@ -673,39 +706,13 @@ void ROCKSAMPLE::GeneratePGS_fake(const STATE& state, const HISTORY& history,
 	int rock = Grid(rockstate.AgentPos);
 	
 	if(rock >= 0){	
-		if(!rockstate.Rocks[rock].Collected && rockstate.Rocks[rock].Count && rockstate.Rocks[rock].Valuable) legal.push_back(E_SAMPLE);
+		if(!rockstate.IsCollected(rock) && rockstate.Count[rock] && rockstate.IsValuable(rock)) legal.push_back(E_SAMPLE);
 	}
 	
-	double p = 0.0;
-	double binaryEntropy = 0.0;
-	
-	int observation;
-	double distance;
-	double efficiency;
-	double likeV = 0.0;
-	double likeW = 0.0;
-	
 	for(int rock=0; rock<NumRocks; rock++){
-		if(rockstate.Rocks[rock].Measured){
-			likeV = rockstate.Rocks[rock].LikelihoodValuable;
-			likeW = rockstate.Rocks[rock].LikelihoodWorthless;
-			
-			observation = GetObservation(rockstate, rock);
-			distance = COORD::EuclideanDistance(rockstate.AgentPos, RockPos[rock]);
-			efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
-			
-			if(observation == E_GOOD){
-				likeV *= efficiency;
-				likeW *= 1.0 - efficiency;
-			}else{         
-				likeW *= efficiency;
-				likeV *= 1.0 - efficiency;
-			}
-			
-			p = (0.5 * rockstate.Rocks[rock].LikelihoodValuable) / (0.5*rockstate.Rocks[rock].LikelihoodValuable + 0.5*rockstate.Rocks[rock].LikelihoodWorthless);
-					
-			binaryEntropy = -1*p*log2(p) - (1-p)*log2(1-p);	
-			if(binaryEntropy <= 0.5) legal.push_back(E_SAMPLE + rock + 1);
+		if(rockstate.Measured[rock]){
+			//Binary entropy <= 0.5
+			if(LowEntropy(rockstate.ProbValuable[rock], UncertainProb)) legal.push_back(E_SAMPLE + rock + 1);
 		}
 		else
 			legal.push_back(E_SAMPLE + rock + 1);		
@@ -736,12 +743,11 @@ void ROCKSAMPLE::GenerateLegal(const STATE& state, const HISTORY& history,
         legal.push_back(COORD::E_WEST);
 
     int rock = Grid(rockstate.AgentPos);
-    if (rock >= 0 && !rockstate.Rocks[rock].Collected)
+    if (rock >= 0 && !rockstate.IsCollected(rock))
         legal.push_back(E_SAMPLE);
 
-    for (rock = 0; rock < NumRocks; ++rock)
-        if (!rockstate.Rocks[rock].Collected)
-            legal.push_back(rock + 1 + E_SAMPLE);
+    for (uint64_t rocks = ~rockstate.Collected & AllRocks; rocks; rocks &= rocks - 1)
+        legal.push_back(__builtin_ctzll(rocks) + 1 + E_SAMPLE);
 }
 
 void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
@@ -770,20 +776,10 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 
 		// Sample rocks with more +ve than -ve observations
 		int rock = Grid(rockstate.AgentPos);
-		if (rock >= 0 && !rockstate.Rocks[rock].Collected)
+		// (Count is the tally of good minus bad check observations)
+		if (rock >= 0 && !rockstate.IsCollected(rock))
 		{
-			int total = 0;
-			for (int t = 0; t < history.Size(); ++t)
-			{
-				if (history[t].Action == rock + 1 + E_SAMPLE)
-				{
-					if (history[t].Observation == E_GOOD)
-						total++;
-					if (history[t].Observation == E_BAD)
-						total--;
-				}
-			}
-			if (total > 0)
+			if (rockstate.Count[rock] > 0)
 			{
 				actions.push_back(E_SAMPLE);
 				return;
@@ -800,22 +796,9 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 
 		for (int rock = 0; rock < NumRocks; ++rock)
 		{
-			const ROCKSAMPLE_STATE::ENTRY& entry = rockstate.Rocks[rock];
-			if (!entry.Collected)
+			if (!rockstate.IsCollected(rock))
 			{
-				int total = 0;
-				for (int t = 0; t < history.Size(); ++t)
-				{
-					if (history[t].Action == rock + 1 + E_SAMPLE)
-					{
-						if (history[t].Observation == E_GOOD)
-							total++;
-						if (history[t].Observation == E_BAD)
-							total--;
-					}
-				}
-
-				if (total >= 0)
+				if (rockstate.Count[rock] >= 0)
 				{
 					all_bad = false;
 
@@ -860,11 +843,11 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 
 		for (rock = 0; rock < NumRocks; ++rock)
 		{
-			if (!rockstate.Rocks[rock].Collected    &&
-				rockstate.Rocks[rock].ProbValuable != 0.0 &&
-				rockstate.Rocks[rock].ProbValuable != 1.0 &&
-				rockstate.Rocks[rock].Measured < 5  &&
-				std::abs(rockstate.Rocks[rock].Count) < 2)
+			if (!rockstate.IsCollected(rock)    &&
+				rockstate.ProbValuable[rock] != 0.0 &&
+				rockstate.ProbValuable[rock] != 1.0 &&
+				rockstate.Measured[rock] < 5  &&
+				std::abs(rockstate.Count[rock]) < 2)
 			{
 				actions.push_back(rock + 1 + E_SAMPLE);
 			}
@@ -874,13 +857,7 @@ void ROCKSAMPLE::GeneratePreferred(const STATE& state, const HISTORY& history,
 
 int ROCKSAMPLE::GetObservation(const ROCKSAMPLE_STATE& rockstate, int rock) const
 {
-    double distance = COORD::EuclideanDistance(rockstate.AgentPos, RockPos[rock]);
-    double efficiency = (1 + pow(2, -distance / HalfEfficiencyDistance)) * 0.5;
-
-    if (Bernoulli(efficiency))
-        return rockstate.Rocks[rock].Valuable ? E_GOOD : E_BAD;
-    else
-        return rockstate.Rocks[rock].Valuable ? E_BAD : E_GOOD;
+    return Bernoulli(CheckEfficiency(rockstate.AgentPos, RockPos[rock])) == rockstate.IsValuable(rock) ? E_GOOD : E_BAD;
 }
 
 int ROCKSAMPLE::SelectTarget(const ROCKSAMPLE_STATE& rockstate) const
@@ -889,8 +866,8 @@ int ROCKSAMPLE::SelectTarget(const ROCKSAMPLE_STATE& rockstate) const
     int bestRock = -1;
     for (int rock = 0; rock < NumRocks; ++rock)
     {
-        if (!rockstate.Rocks[rock].Collected
-            && rockstate.Rocks[rock].Count >= UncertaintyCount)
+        if (!rockstate.IsCollected(rock)
+            && rockstate.Count[rock] >= UncertaintyCount)
         {
             int dist = COORD::ManhattanDistance(rockstate.AgentPos, RockPos[rock]);
             if (dist < bestDist)
@@ -929,11 +906,10 @@ void ROCKSAMPLE::DisplayState(const STATE& state, std::ostream& ostr) const
         {
             COORD pos(x, y);
             int rock = Grid(pos);
-            const ROCKSAMPLE_STATE::ENTRY& entry = rockstate.Rocks[rock];
             if (rockstate.AgentPos == COORD(x, y))
                 ostr << "* ";
-            else if (rock >= 0 && !entry.Collected)
-                ostr << rock << (entry.Valuable ? "$" : "X");
+            else if (rock >= 0 && !rockstate.IsCollected(rock))
+                ostr << rock << (rockstate.IsValuable(rock) ? "$" : "X");
             else
                 ostr << ". ";
         }
@@ -4,38 +4,46 @@
 #include "simulator.h"
 #include "coord.h"
 #include "grid.h"
+#include <stdint.h>
 
 class ROCKSAMPLE_STATE : public STATE
 {
 public:
 
+    static const int MaxRocks = 64;
+
     COORD AgentPos;
-    struct ENTRY
-    {
-        bool Valuable;
-        bool Collected;
-        int Count;    				// Smart knowledge
-        int Measured; 				// Smart knowledge
-        double LikelihoodValuable;	// Smart knowledge
-        double LikelihoodWorthless;	// Smart knowledge
-        double ProbValuable;		// Smart knowledge
-    };
-    std::vector<ENTRY> Rocks;
+    uint64_t Valuable;  				// One bit per rock
+    uint64_t Collected; 				// One bit per rock
+    uint64_t Checked;   				// Measured at least once
+    uint64_t Counted;   				// Count != 0
+    uint64_t Uncertain; 				// Checked, and entropy of ProbValuable > 0.5
+    int16_t Count[MaxRocks];    		// Smart knowledge
+    int16_t Measured[MaxRocks]; 		// Smart knowledge
+    double ProbValuable[MaxRocks];		// Smart knowledge
     int Target; // Smart knowledge
+
+    static uint64_t Bit(int rock) { return (uint64_t) 1 << rock; }
+    bool IsValuable(int rock) const { return (Valuable >> rock) & 1; }
+    bool IsCollected(int rock) const { return (Collected >> rock) & 1; }
 };
 
-class ROCKSAMPLE : public SIMULATOR
+class ROCKSAMPLE final : public SIMULATOR
 {
 public:
 
     ROCKSAMPLE(int size, int rocks);
 
     virtual STATE* Copy(const STATE& state) const;
+    virtual bool Hash(const STATE& state, std::size_t& hash) const;
+    virtual bool Equal(const STATE& state1, const STATE& state2) const;
     virtual void Validate(const STATE& state) const;
     virtual STATE* CreateStartState() const;
     virtual void FreeState(STATE* state) const;
     virtual bool Step(STATE& state, int action,
         int& observation, double& reward) const;
+    virtual void StepBatch(STATE** states, const int* actions,
+        int* observations, double* rewards, bool* terminal, int n) const;
 
 	/*** Added by JCS to test PGS ***/
 	//Uses regular POMCP Step
@@ -44,11 +52,27 @@ public:
 	//Step with PGS rewards
 	bool StepPGS(STATE& state, int action,
         int& observation, double& reward) const;
+	//Step for rollout level LEVEL, chosen at compile time by the search
+	template <int LEVEL>
+	bool StepLevel(STATE& state, int action,
+        int& observation, double& reward) const
+	{
+	    if (LEVEL >= KNOWLEDGE::PGS)
+	        return StepPGS(state, action, observation, reward);
+	    return StepNormal(state, action, observation, reward);
+	}
 	// Simple Step (transition only)
 	bool SimpleStep(STATE& state, int action) const;
 	//PGS Rollout policy
 	void GeneratePGS(const STATE& state, const HISTORY& history,
         std::vector<int>& legal, const STATUS& status) const;
+	//PGS chooses among all legal actions
+	void PGSCandidates(const STATE& state, const HISTORY& history,
+        std::vector<int>& actions, const STATUS& status) const { GenerateLegal(state, history, actions, status); }
+	bool RolloutKey(const STATE& state, uint64_t& key) const;
+	bool RolloutHistory() const { return false; } //Rollout policies only read the state
+	void TrimMemory() const { MemoryPool.Trim(); }
+	void DisplayMemory(std::ostream& ostr) const { MemoryPool.DisplayStatistics("State", ostr); }
 	void GeneratePGS_fake(const STATE& state, const HISTORY& history,
         std::vector<int>& legal, const STATUS& status) const;
 	//Compute PGS value
@@ -86,16 +110,28 @@ protected:
     void InitGeneral();
     void Init_7_8();
     void Init_11_11();
+    void InitEfficiency();
+    double CheckEfficiency(const COORD& agent, const COORD& rock) const
+    {
+        return Efficiency(std::abs(agent.X - rock.X), std::abs(agent.Y - rock.Y));
+    }
     int GetObservation(const ROCKSAMPLE_STATE& rockstate, int rock) const;
+    void UpdateCheck(ROCKSAMPLE_STATE& rockstate, int rock,
+        int observation, double efficiency) const;
+    int RockPoints(const ROCKSAMPLE_STATE& rockstate, uint64_t rocks) const;
     int SelectTarget(const ROCKSAMPLE_STATE& rockstate) const;
 
     GRID<int> Grid;
     std::vector<COORD> RockPos;
     int Size, NumRocks;
+    uint64_t AllRocks; // Mask of the rocks in use
     COORD StartPos;
     double HalfEfficiencyDistance;
+    GRID<double> Efficiency; // Sensor efficiency by (|dx|, |dy|) to the rock
+    double UncertainProb; // Probability with binary entropy 0.5
     double SmartMoveProb;
     int UncertaintyCount;
+    double PGSAlpha; // PGS reward scaling, for StepPGS and StepBatch
 
 private:
 
@@ -1,4 +1,5 @@
 #include "simulator.h"
+#include <thread>
 
 using namespace std;
 using namespace UTILS;
@@ -7,7 +8,8 @@ SIMULATOR::KNOWLEDGE::KNOWLEDGE()
 :   TreeLevel(LEGAL),
     RolloutLevel(LEGAL),
     SmartTreeCount(10),
-    SmartTreeValue(1.0)
+    SmartTreeValue(1.0),
+    CachePGS(false)
 {
 }
 
@@ -21,32 +23,162 @@ SIMULATOR::SIMULATOR()
 :   Discount(1.0),
     NumActions(0),
     NumObservations(0),
-    RewardRange(1.0)
+    RewardRange(1.0),
+    PGSCache(0),
+    StepLatency(0),
+    StepThread(0),
+    NumInFlight(0),
+    NumCompleted(0),
+    NumWaited(0),
+    StopSteps(false)
 {
 }
 
 SIMULATOR::SIMULATOR(int numActions, int numObservations, double discount)
 :   NumActions(numActions),
     NumObservations(numObservations),
-    Discount(discount)
+    Discount(discount),
+    PGSCache(0),
+    StepLatency(0),
+    StepThread(0),
+    NumInFlight(0),
+    NumCompleted(0),
+    NumWaited(0),
+    StopSteps(false)
 { 
     assert(discount > 0 && discount <= 1);
 }
 
 SIMULATOR::~SIMULATOR() 
 { 
+    if (StepThread)
+    {
+        {
+            std::lock_guard<std::mutex> lock(StepMutex);
+            assert(NumInFlight == 0);
+            StopSteps = true;
+        }
+        StepCondition.notify_one();
+        StepThread->join();
+        delete StepThread;
+    }
+    delete PGSCache;
+}
+
+void SIMULATOR::SetKnowledge(const KNOWLEDGE& knowledge)
+{
+    Knowledge = knowledge;
+    if (Knowledge.RolloutLevel >= KNOWLEDGE::PGS && Knowledge.CachePGS && !PGSCache)
+        PGSCache = new PGS_CACHE;
 }
 
 void SIMULATOR::Validate(const STATE& state) const 
 { 
 }
 
+bool SIMULATOR::Hash(const STATE& state, std::size_t& hash) const
+{
+    return false;
+}
+
+bool SIMULATOR::Equal(const STATE& state1, const STATE& state2) const
+{
+    return false;
+}
+
+void SIMULATOR::StepBatch(STATE** states, const int* actions,
+    int* observations, double* rewards, bool* terminal, int n) const
+{
+    for (int i = 0; i < n; ++i)
+    {
+        bool result = Step(*states[i], actions[i], observations[i], rewards[i]);
+        if (terminal)
+            terminal[i] = result;
+    }
+}
+
+void SIMULATOR::BeginStep(ASYNC_STEP& step) const
+{
+    if (StepLatency <= 0)
+    {
+        step.Reward = 0;
+        step.Terminal = Step(*step.State, step.Action, step.Observation, step.Reward);
+        step.Done = true;
+        return;
+    }
+
+    step.Done = false;
+    {
+        std::lock_guard<std::mutex> lock(StepMutex);
+        if (!StepThread)
+            StepThread = new std::thread(&SIMULATOR::RunSteps, this);
+        PendingSteps.push(std::make_pair(std::chrono::steady_clock::now()
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double, std::milli>(StepLatency)), &step));
+        NumInFlight++;
+    }
+    StepCondition.notify_one();
+}
+
+void SIMULATOR::WaitSteps() const
+{
+    std::unique_lock<std::mutex> lock(StepMutex);
+    DoneCondition.wait(lock, [this] { return NumCompleted != NumWaited || NumInFlight == 0; });
+    NumWaited = NumCompleted;
+}
+
+// Runs each pending step once its latency has passed, as an external model
+// would answer, with its own random seed and memory pool caches
+void SIMULATOR::RunSteps() const
+{
+    THREAD_SLOT::Acquire();
+    unsigned int seed = 1;
+    SetThreadSeed(&seed);
+
+    std::unique_lock<std::mutex> lock(StepMutex);
+    while (!StopSteps)
+    {
+        if (PendingSteps.empty())
+        {
+            StepCondition.wait(lock);
+            continue;
+        }
+        PENDING_STEP next = PendingSteps.top();
+        if (std::chrono::steady_clock::now() < next.first)
+        {
+            StepCondition.wait_until(lock, next.first);
+            continue;
+        }
+        PendingSteps.pop();
+        lock.unlock();
+
+        ASYNC_STEP& step = *next.second;
+        step.Reward = 0;
+        step.Terminal = Step(*step.State, step.Action, step.Observation, step.Reward);
+        step.Done = true;
+
+        lock.lock();
+        NumInFlight--;
+        NumCompleted++;
+        DoneCondition.notify_all();
+    }
+
+    SetThreadSeed(0);
+    THREAD_SLOT::Release();
+}
+
 bool SIMULATOR::LocalMove(STATE& state, const HISTORY& history,
     int stepObs, const STATUS& status) const
 {
     return true;
 }
 
+bool SIMULATOR::ConditionedMove(STATE& state, const HISTORY& history,
+    int stepObs, const STATUS& status) const
+{
+    return LocalMove(state, history, stepObs, status);
+}
+
 void SIMULATOR::GenerateRelevant(const STATE& state, const HISTORY& history,
     std::vector<int>& actions, const STATUS& status) const
 {
@@ -85,103 +217,33 @@ void SIMULATOR::GeneratePGS(const STATE& state, const HISTORY& history,
 {
 }
 
-void SIMULATOR::PGSLegal(const STATE& state, const HISTORY& history,
-    std::vector<int>& actions, const STATUS& status) const
+bool SIMULATOR::RolloutKey(const STATE& state, uint64_t& key) const
 {
+    return false;
 }
 
-int SIMULATOR::SelectRandom(const STATE& state, const HISTORY& history,
-    const STATUS& status) const
+bool SIMULATOR::RolloutHistory() const
 {
-    static vector<int> actions;
-
-    if (Knowledge.RolloutLevel >= KNOWLEDGE::PGS)
-    {
-        actions.clear();
-        GeneratePGS(state, history, actions, status);
-        if (!actions.empty())
-            return actions[Random(actions.size())];
-    }
-
-    if (Knowledge.RolloutLevel >= KNOWLEDGE::SMART)
-    {		  
-        actions.clear();
-        GeneratePreferred(state, history, actions, status);
-        if (!actions.empty())
-            return actions[Random(actions.size())];
-    }
-        
-    if (Knowledge.RolloutLevel >= KNOWLEDGE::LEGAL)
-    {
-        actions.clear();
-        GenerateLegal(state, history, actions, status);
-        if (!actions.empty())
-            return actions[Random(actions.size())];
-    }
-
-    return Random(NumActions);
+    return true;
 }
 
-//TODO: Add prior values from knowledge representation, heuristics, etc.
-//This is where a KR would go, initializing prior state values when the nodes are first expanded.
-//If using something like a NN, getPriorValues(NN, state, count, value) --> qnode.Value.Set(count, value)
-void SIMULATOR::Prior(const STATE* state, const HISTORY& history,
-    VNODE* vnode, const STATUS& status) const
+void SIMULATOR::TrimMemory() const
 {
-    static vector<int> actions;
-    
-    if (Knowledge.TreeLevel == KNOWLEDGE::PURE || state == 0)
-    {
-        vnode->SetChildren(0, 0);
-        return;
-    }
-    else
-    {
-        vnode->SetChildren(+LargeInteger, -Infinity);
-    }
-
-    if (Knowledge.TreeLevel >= KNOWLEDGE::LEGAL)
-    {
-        actions.clear();
-        GenerateLegal(*state, history, actions, status);
+}
 
-        for (vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
-        {
-            int a = *i_action;
-            QNODE& qnode = vnode->Child(a);
-            qnode.Value.Set(0, 0);
-            qnode.AMAF.Set(0, 0);
-        }
-    }
-	 //TODO: review and possibly improve node initialization.  Eg. initial values.  Also, must ALL actions be pre-added?
-	 if (Knowledge.TreeLevel >= KNOWLEDGE::PGS)
-    {
-        actions.clear();
-        GenerateLegal(*state, history, actions, status);  //TODO: should this use generatePGS instead? maybe...
+void SIMULATOR::DisplayMemory(std::ostream& ostr) const
+{
+}
 
-        for (vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
-        {
-            int a = *i_action;
-            QNODE& qnode = vnode->Child(a);
-            qnode.Value.Set(0, 0);
-            qnode.AMAF.Set(0, 0);
-        }
-    }
-	 else if (Knowledge.TreeLevel >= KNOWLEDGE::SMART)
-    {
-        actions.clear();
-        GeneratePreferred(*state, history, actions, status);
+void SIMULATOR::PGSLegal(const STATE& state, const HISTORY& history,
+    std::vector<int>& actions, const STATUS& status) const
+{
+}
 
-        for (vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
-        {
-            int a = *i_action;
-            QNODE& qnode = vnode->Child(a);
-            qnode.Value.Set(Knowledge.SmartTreeCount, Knowledge.SmartTreeValue);
-            qnode.AMAF.Set(Knowledge.SmartTreeCount, Knowledge.SmartTreeValue);
-        }    
-    }
-	 
-	 
+void SIMULATOR::PGSCandidates(const STATE& state, const HISTORY& history,
+    std::vector<int>& actions, const STATUS& status) const
+{
+    PGSLegal(state, history, actions, status);
 }
 
 void SIMULATOR::DisplayBeliefs(const BELIEF_STATE& beliefState, 
@@ -6,10 +6,18 @@
 #include "utils.h"
 #include <iostream>
 #include <math.h>
+#include <chrono>
+#include <queue>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 
 #include "grid.h"
 
 #include "ftable.h"
+#include "pgscache.h"
 
 class BELIEF_STATE;
 
@@ -45,6 +53,7 @@ public:
         int TreeLevel; //NODE Initialization policy -- e.g. for preferred actions
         int SmartTreeCount; // If TreeLevel > SMART, use SmartCount
         double SmartTreeValue; // If TreeLevel > SMART, use SmartValue
+        bool CachePGS; // If RolloutLevel >= PGS, reuse PGS actions by RolloutKey
         
         int Level(int phase) const
         {
@@ -78,6 +87,17 @@ public:
         int Phase;
         int Particles;
     };
+
+    // A step in flight, see BeginStep. The outcome is valid once Done is set.
+    struct ASYNC_STEP
+    {
+        STATE* State;
+        int Action;
+        int Observation;
+        double Reward;
+        bool Terminal;
+        std::atomic<bool> Done;
+    };
 	 
 	 /////////////////////////
 	 //Incremental refinement
@@ -100,9 +120,35 @@ public:
     // Return value of true indicates termination of episode (if episodic)
     virtual bool Step(STATE& state, int action, 
         int& observation, double& reward) const = 0;
+
+    // Step for rollout knowledge LEVEL, which domains with a level
+    // dependent Step hide to bind it at compile time
+    template <int LEVEL>
+    bool StepLevel(STATE& state, int action,
+        int& observation, double& reward) const { return Step(state, action, observation, reward); }
+
+    // Step n states at once, one action each (terminal may be 0).
+    // The default loops over Step; domains can override it to advance
+    // all particles in lockstep.
+    virtual void StepBatch(STATE** states, const int* actions,
+        int* observations, double* rewards, bool* terminal, int n) const;
+
+    // Asynchronous Step, for simulators that wrap slow external models.
+    // BeginStep starts a step of step.State with step.Action, the outcome
+    // is valid once step.Done is set. WaitSteps blocks until at least one
+    // started step is done. The defaults step at once without StepLatency.
+    // With it they stand in for an external model: a model thread runs
+    // each Step once its latency has passed, while the caller goes on.
+    virtual void BeginStep(ASYNC_STEP& step) const;
+    virtual void WaitSteps() const;
         
     // Create new state and copy argument (must be same type)
     virtual STATE* Copy(const STATE& state) const = 0;
+
+    // Hash and compare states, used to merge duplicate particles
+    // Return false from Hash if the domain does not support it
+    virtual bool Hash(const STATE& state, std::size_t& hash) const;
+    virtual bool Equal(const STATE& state1, const STATE& state2) const;
     
     // Sanity check
     virtual void Validate(const STATE& state) const;
@@ -111,15 +157,39 @@ public:
     virtual bool LocalMove(STATE& state, const HISTORY& history,
         int stepObs, const STATUS& status) const;
 
+    // As LocalMove, but only proposes changes that are consistent with the
+    // last history entry instead of rejecting them afterwards.
+    // Defaults to LocalMove for domains without a constructive move.
+    virtual bool ConditionedMove(STATE& state, const HISTORY& history,
+        int stepObs, const STATUS& status) const;
+
     // Use domain knowledge to assign prior value and confidence to actions
     // Should only use fully observable state variables
     void Prior(const STATE* state, const HISTORY& history, VNODE* vnode,
-        const STATUS& status) const;
+        const STATUS& status) const { Prior(*this, state, history, vnode, status); }
 
     // Use domain knowledge to select actions stochastically during rollouts
     // Should only use fully observable state variables
     int SelectRandom(const STATE& state, const HISTORY& history,
-        const STATUS& status) const;
+        const STATUS& status) const { return SelectRandom(*this, state, history, status); }
+
+    // Prior and SelectRandom for a simulator of type DOMAIN, which binds
+    // the action generators statically for final domain classes
+    template <class DOMAIN>
+    static void Prior(const DOMAIN& simulator, const STATE* state,
+        const HISTORY& history, VNODE* vnode, const STATUS& status);
+    template <class DOMAIN>
+    static int SelectRandom(const DOMAIN& simulator, const STATE& state,
+        const HISTORY& history, const STATUS& status);
+    // As SelectRandom, for the rollout knowledge LEVEL
+    template <int LEVEL, class DOMAIN>
+    static int SelectRandom(const DOMAIN& simulator, const STATE& state,
+        const HISTORY& history, const STATUS& status);
+    // True if all actions are PGS candidates in state, so that a cached
+    // entry was not stored for another state with the same rollout key
+    template <class DOMAIN>
+    static bool CheckPGS(const DOMAIN& simulator, const STATE& state,
+        const HISTORY& history, const std::vector<int>& actions, const STATUS& status);
 
     // Generate set of legal actions
     virtual void GenerateLegal(const STATE& state, const HISTORY& history, 
@@ -138,6 +208,18 @@ public:
     // Generate set of PGS actions
     virtual void GeneratePGS(const STATE& state, const HISTORY& history,
                                    std::vector<int>& actions, const STATUS& status) const;
+    // Actions GeneratePGS chooses from, defaults to PGSLegal
+    virtual void PGSCandidates(const STATE& state, const HISTORY& history,
+        std::vector<int>& actions, const STATUS& status) const;
+    // Key of all state variables the PGS rollout policy depends on
+    // Return false if PGS actions should not be cached
+    virtual bool RolloutKey(const STATE& state, uint64_t& key) const;
+    // Return false if no rollout policy reads the history, so that
+    // rollouts do not need to record it
+    virtual bool RolloutHistory() const;
+    // Return unused chunks of the state pool, and display its usage
+    virtual void TrimMemory() const;
+    virtual void DisplayMemory(std::ostream& ostr) const;
 
     // Textual display
     virtual void DisplayBeliefs(const BELIEF_STATE& beliefState, 
@@ -148,7 +230,8 @@ public:
     virtual void DisplayReward(double reward, std::ostream& ostr) const;
 
     // Accessors
-    void SetKnowledge(const KNOWLEDGE& knowledge) { Knowledge = knowledge; }
+    void SetKnowledge(const KNOWLEDGE& knowledge);
+    const KNOWLEDGE& GetKnowledge() const { return Knowledge; }
     int GetNumActions() const { return NumActions; }
     int GetNumObservations() const { return NumObservations; }
     bool IsEpisodic() const { return false; }
@@ -156,6 +239,8 @@ public:
     double GetFDiscount() const { return fDiscount; }
     double GetRewardRange() const { return RewardRange; }
     double GetHorizon(double accuracy, int undiscountedHorizon = 100) const;
+    const PGS_CACHE* GetPGSCache() const { return PGSCache; }
+    void SetStepLatency(double milliseconds) { StepLatency = milliseconds; }
 	 
 	 //For initial state consistency
 	 //virtual const GRID* GetGrid() const;
@@ -167,6 +252,163 @@ protected:
     double Discount, RewardRange;
     double fDiscount;
     KNOWLEDGE Knowledge;
+
+private:
+
+    mutable PGS_CACHE* PGSCache; // Only allocated for PGS rollouts
+
+    // Model thread of the StepLatency stand-in, started by the first step
+    void RunSteps() const;
+
+    // Asynchronous steps waiting for their latency, earliest first
+    typedef std::pair<std::chrono::steady_clock::time_point, ASYNC_STEP*> PENDING_STEP;
+    double StepLatency;
+    mutable std::priority_queue<PENDING_STEP, std::vector<PENDING_STEP>,
+        std::greater<PENDING_STEP> > PendingSteps;
+    mutable std::thread* StepThread;
+    mutable std::mutex StepMutex;
+    mutable std::condition_variable StepCondition, DoneCondition;
+    mutable int NumInFlight, NumCompleted, NumWaited;
+    mutable bool StopSteps;
 };
 
+template <class DOMAIN>
+int SIMULATOR::SelectRandom(const DOMAIN& simulator, const STATE& state,
+    const HISTORY& history, const STATUS& status)
+{
+    int level = simulator.GetKnowledge().RolloutLevel;
+    if (level >= KNOWLEDGE::PGS)
+        return SelectRandom<KNOWLEDGE::PGS>(simulator, state, history, status);
+    if (level >= KNOWLEDGE::SMART)
+        return SelectRandom<KNOWLEDGE::SMART>(simulator, state, history, status);
+    if (level >= KNOWLEDGE::LEGAL)
+        return SelectRandom<KNOWLEDGE::LEGAL>(simulator, state, history, status);
+    return SelectRandom<KNOWLEDGE::PURE>(simulator, state, history, status);
+}
+
+template <int LEVEL, class DOMAIN>
+int SIMULATOR::SelectRandom(const DOMAIN& simulator, const STATE& state,
+    const HISTORY& history, const STATUS& status)
+{
+    static std::vector<int> actions;
+    const SIMULATOR& base = simulator;
+
+    if (LEVEL >= KNOWLEDGE::PGS)
+    {
+        actions.clear();
+        uint64_t key;
+        bool cacheable = base.PGSCache && simulator.RolloutKey(state, key);
+        bool cached = cacheable && base.PGSCache->Lookup(key, actions);
+        if (cached && !CheckPGS(simulator, state, history, actions, status))
+        {
+            base.PGSCache->Reject();
+            actions.clear();
+            cached = false;
+        }
+        if (!cached)
+        {
+            simulator.GeneratePGS(state, history, actions, status);
+            if (cacheable)
+                base.PGSCache->Insert(key, actions);
+        }
+        if (!actions.empty())
+            return actions[UTILS::Random(actions.size())];
+    }
+
+    if (LEVEL >= KNOWLEDGE::SMART)
+    {		  
+        actions.clear();
+        simulator.GeneratePreferred(state, history, actions, status);
+        if (!actions.empty())
+            return actions[UTILS::Random(actions.size())];
+    }
+        
+    if (LEVEL >= KNOWLEDGE::LEGAL)
+    {
+        actions.clear();
+        simulator.GenerateLegal(state, history, actions, status);
+        if (!actions.empty())
+            return actions[UTILS::Random(actions.size())];
+    }
+
+    return UTILS::Random(base.NumActions);
+}
+
+template <class DOMAIN>
+bool SIMULATOR::CheckPGS(const DOMAIN& simulator, const STATE& state,
+    const HISTORY& history, const std::vector<int>& actions, const STATUS& status)
+{
+    static std::vector<int> candidates;
+    candidates.clear();
+    simulator.PGSCandidates(state, history, candidates, status);
+    for (std::vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
+        if (std::find(candidates.begin(), candidates.end(), *i_action) == candidates.end())
+            return false;
+    return true;
+}
+
+//TODO: Add prior values from knowledge representation, heuristics, etc.
+//This is where a KR would go, initializing prior state values when the nodes are first expanded.
+//If using something like a NN, getPriorValues(NN, state, count, value) --> qnode.Value.Set(count, value)
+template <class DOMAIN>
+void SIMULATOR::Prior(const DOMAIN& simulator, const STATE* state,
+    const HISTORY& history, VNODE* vnode, const STATUS& status)
+{
+    static std::vector<int> actions;
+    const KNOWLEDGE& knowledge = static_cast<const SIMULATOR&>(simulator).Knowledge;
+    
+    if (knowledge.TreeLevel == KNOWLEDGE::PURE || state == 0)
+    {
+        vnode->SetChildren(0, 0);
+        return;
+    }
+    else
+    {
+        vnode->SetChildren(+LargeInteger, -Infinity);
+    }
+
+    if (knowledge.TreeLevel >= KNOWLEDGE::LEGAL)
+    {
+        actions.clear();
+        simulator.GenerateLegal(*state, history, actions, status);
+
+        for (std::vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
+        {
+            int a = *i_action;
+            QNODE& qnode = vnode->Child(a);
+            qnode.Value.Set(0, 0);
+            qnode.AMAF.Set(0, 0);
+        }
+    }
+	 //TODO: review and possibly improve node initialization.  Eg. initial values.  Also, must ALL actions be pre-added?
+	 if (knowledge.TreeLevel >= KNOWLEDGE::PGS)
+    {
+        actions.clear();
+        simulator.GenerateLegal(*state, history, actions, status);  //TODO: should this use generatePGS instead? maybe...
+
+        for (std::vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
+        {
+            int a = *i_action;
+            QNODE& qnode = vnode->Child(a);
+            qnode.Value.Set(0, 0);
+            qnode.AMAF.Set(0, 0);
+        }
+    }
+	 else if (knowledge.TreeLevel >= KNOWLEDGE::SMART)
+    {
+        actions.clear();
+        simulator.GeneratePreferred(*state, history, actions, status);
+
+        for (std::vector<int>::const_iterator i_action = actions.begin(); i_action != actions.end(); ++i_action)
+        {
+            int a = *i_action;
+            QNODE& qnode = vnode->Child(a);
+            qnode.Value.Set(knowledge.SmartTreeCount, knowledge.SmartTreeValue);
+            qnode.AMAF.Set(knowledge.SmartTreeCount, knowledge.SmartTreeValue);
+        }    
+    }
+	 
+	 
+}
+
 #endif // SIMULATOR_H
@@ -0,0 +1,89 @@
+#include "threadpool.h"
+#include "memorypool.h"
+#include <assert.h>
+#include <pthread.h>
+
+THREAD_POOL::THREAD_POOL(int numThreads, bool pin)
+:   NumThreads(numThreads),
+    Pinned(pin),
+    Task(0),
+    Generation(0),
+    Running(0),
+    Stop(false)
+{
+    assert(NumThreads >= 1);
+    for (int i = 1; i < NumThreads; ++i)
+        Threads.push_back(std::thread(&THREAD_POOL::Worker, this, i));
+}
+
+THREAD_POOL::~THREAD_POOL()
+{
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        Stop = true;
+    }
+    StartCondition.notify_all();
+    for (int i = 0; i < (int) Threads.size(); ++i)
+        Threads[i].join();
+}
+
+void THREAD_POOL::Run(const std::function<void(int)>& task)
+{
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        Task = &task;
+        Running = NumThreads - 1;
+        Generation++;
+    }
+    StartCondition.notify_all();
+
+    task(0);
+
+    std::unique_lock<std::mutex> lock(Mutex);
+    DoneCondition.wait(lock, [this] { return Running == 0; });
+    Task = 0;
+}
+
+void THREAD_POOL::Worker(int thread)
+{
+    if (Pinned)
+        Pin(thread);
+    THREAD_SLOT::Acquire();
+
+    int generation = 0;
+    while (true)
+    {
+        const std::function<void(int)>* task;
+        {
+            std::unique_lock<std::mutex> lock(Mutex);
+            StartCondition.wait(lock, [this, generation] { return Stop || Generation != generation; });
+            if (Stop)
+                break;
+            generation = Generation;
+            task = Task;
+        }
+
+        (*task)(thread);
+
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            Running--;
+        }
+        DoneCondition.notify_one();
+    }
+
+    THREAD_SLOT::Release();
+}
+
+// Worker i of n runs on CPU i * cpus / n, assuming CPUs are numbered
+// node by node
+void THREAD_POOL::Pin(int thread)
+{
+    int cpus = std::thread::hardware_concurrency();
+    if (cpus <= 0)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET((long long) thread * cpus / NumThreads, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
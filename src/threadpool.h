@@ -0,0 +1,45 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+/*
+    Fixed set of persistent worker threads. Run() executes the same task
+    once per thread (the calling thread acts as thread 0) and returns when
+    all threads have finished. Workers take a memory pool slot, so that
+    they allocate from their own pool caches, and can be pinned to CPUs
+    spread evenly over the machine, which keeps each worker and the pool
+    chunks it touches first on one NUMA node.
+*/
+class THREAD_POOL
+{
+public:
+
+    THREAD_POOL(int numThreads, bool pin = false);
+    ~THREAD_POOL();
+
+    void Run(const std::function<void(int)>& task);
+
+    int GetNumThreads() const { return NumThreads; }
+
+private:
+
+    void Worker(int thread);
+
+    void Pin(int thread);
+
+    int NumThreads;
+    bool Pinned;
+    std::vector<std::thread> Threads;
+    std::mutex Mutex;
+    std::condition_variable StartCondition, DoneCondition;
+    const std::function<void(int)>* Task;
+    int Generation, Running;
+    bool Stop;
+};
+
+#endif // THREAD_POOL_H
@@ -3,6 +3,26 @@
 namespace UTILS
 {
 
+thread_local unsigned int* ThreadSeed = 0;
+
+double BinaryEntropyBound(double limit)
+{
+    if (BinaryEntropy(0.5) <= limit)
+        return 0.5;
+    double lo = 0, hi = 0.5;
+    while (true)
+    {
+        double mid = (lo + hi) * 0.5;
+        if (mid <= lo || mid >= hi)
+            break;
+        if (BinaryEntropy(mid) <= limit)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
 void UnitTest()
 {
     assert(Sign(+10) == +1);
@@ -3,11 +3,13 @@
 
 #include <vector>
 #include <stdlib.h>
+#include <stdint.h>
 #include <math.h>
 #include <assert.h>
 #include "coord.h"
 #include "memorypool.h"
 #include <algorithm>
+#include <functional>
 
 #define LargeInteger 1000000
 #define Infinity 1e+10
@@ -27,19 +29,33 @@ inline int Sign(int x)
     return (x > 0) - (x < 0);
 }
 
+// Worker threads draw from their own generator state, the main thread
+// keeps using rand() so sequential runs are unchanged
+extern thread_local unsigned int* ThreadSeed;
+
+inline int Rand()
+{
+    return ThreadSeed ? rand_r(ThreadSeed) : rand();
+}
+
+inline void SetThreadSeed(unsigned int* seed)
+{
+    ThreadSeed = seed;
+}
+
 inline int Random(int max)
 {
-    return rand() % max;
+    return Rand() % max;
 }
 
 inline int Random(int min, int max)
 {
-    return rand() % (max - min) + min;
+    return Rand() % (max - min) + min;
 }
 
 inline double RandomDouble(double min, double max)
 {
-    return (double) rand() / RAND_MAX * (max - min) + min;
+    return (double) Rand() / RAND_MAX * (max - min) + min;
 }
 
 inline void RandomSeed(int seed)
@@ -49,7 +65,7 @@ inline void RandomSeed(int seed)
 
 inline bool Bernoulli(double p)
 {
-    return rand() < p * RAND_MAX;
+    return Rand() < p * RAND_MAX;
 }
 
 inline bool Near(double x, double y, double tol)
@@ -61,6 +77,42 @@ inline bool CheckFlag(int flags, int bit) { return (flags & (1 << bit)) != 0; }
 
 inline void SetFlag(int& flags, int bit) { flags = (flags | (1 << bit)); }
 
+// std::hash is the identity for integers, so values are mixed first
+// (64-bit finalizer) to keep structured inputs such as bitmasks apart
+template<class T>
+inline void HashCombine(std::size_t& seed, const T& value)
+{
+    uint64_t h = std::hash<T>()(value);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    seed ^= h + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+
+inline double BinaryEntropy(double p)
+{
+    return -p * log2(p) - (1 - p) * log2(1 - p);
+}
+
+// Largest p <= 0.5 with BinaryEntropy(p) <= limit. The entropy is
+// symmetric and increasing on [0, 0.5], so for 0 < p < 1
+// BinaryEntropy(p) <= limit exactly when p <= bound or p >= 1 - bound
+double BinaryEntropyBound(double limit);
+
+// Table versions of BinaryEntropy(p) <= limit and > limit. Like the
+// formula (NaN), p = 0 and p = 1 pass neither test
+inline bool LowEntropy(double p, double bound)
+{
+    return p > 0 && p < 1 && (p <= bound || p >= 1 - bound);
+}
+
+inline bool HighEntropy(double p, double bound)
+{
+    return p > bound && p < 1 - bound;
+}
+
 template<class T>
 inline bool Contains(std::vector<T>& vec, const T& item)
 {